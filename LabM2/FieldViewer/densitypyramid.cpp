@@ -0,0 +1,246 @@
+#include "densitypyramid.h"
+
+#include <algorithm>
+
+namespace
+{
+    const size_t RANGE_BLOCKS = 32u;//!< Наибольшее число блоков по стороне при поиске диапазона значений
+}
+
+void DensityPyramid::fromField(const Field& field)
+{
+    clear();
+    if(!field.m_width || !field.m_height)
+        return;
+
+    Level& cells = resetCells(field.m_width, field.m_height, false);
+    for(const Slice& slice : field.m_slices)
+    {
+        const size_t rows = slice.m_values.size() / slice.m_stride;
+        for(size_t row = 0; row < rows; ++row)
+        {
+            const values_t* values = &slice.m_values[row * slice.m_stride];
+            uint8_t* density = &cells.m_density[(slice.m_globalY + row) * cells.m_width + slice.m_globalX];
+            for(size_t column = 0; column < slice.m_stride; ++column)
+                density[column] = values[column] ? 255 : 0;
+        }
+    }
+    buildLevels();
+}
+
+void DensityPyramid::fromCells(const values_t* cells, const size_t width, const size_t height)
+{
+    clear();
+    if(!width || !height)
+        return;
+
+    Level& level = resetCells(width, height, false);
+    for(size_t cell = 0; cell < width * height; ++cell)
+        level.m_density[cell] = cells[cell] ? 255 : 0;
+    buildLevels();
+}
+
+void DensityPyramid::fromSnapshot(const SnapshotView<values_t>& snapshot)
+{
+    clear();
+    if(!snapshot.width() || !snapshot.height())
+        return;
+
+    Level& cells = resetCells(snapshot.width(), snapshot.height(), false);
+    for(size_t slice = 0; slice < snapshot.slicesCount(); ++slice)
+    {
+        const SnapshotSliceEntry& entry = snapshot.slice(slice);
+        for(size_t row = 0; row < entry.m_rows; ++row)
+        {
+            const values_t* values = snapshot.row(slice, row);
+            uint8_t* density = &cells.m_density[(entry.m_globalY + row) * cells.m_width + entry.m_globalX];
+            for(size_t column = 0; column < entry.m_stride; ++column)
+                density[column] = values[column] ? 255 : 0;
+        }
+    }
+    buildLevels();
+}
+
+void DensityPyramid::fromValueField(const ValueField& field)
+{
+    clear();
+    if(!field.m_width || !field.m_height)
+        return;
+
+    Level& cells = resetCells(field.m_width, field.m_height, true);
+    for(const BasicSlice<double>& slice : field.m_slices)
+    {
+        const size_t rows = slice.m_values.size() / slice.m_stride;
+        for(size_t row = 0; row < rows; ++row)
+        {
+            const double* values = &slice.m_values[row * slice.m_stride];
+            float* mean = &cells.m_mean[(slice.m_globalY + row) * cells.m_width + slice.m_globalX];
+            for(size_t column = 0; column < slice.m_stride; ++column)
+                mean[column] = static_cast<float>(values[column]);
+        }
+    }
+    //На нулевом уровне минимум и максимум блока совпадают со значением
+    cells.m_minimum = cells.m_mean;
+    cells.m_maximum = cells.m_mean;
+    buildLevels();
+}
+
+void DensityPyramid::fromValueSnapshot(const SnapshotView<double>& snapshot)
+{
+    clear();
+    if(!snapshot.width() || !snapshot.height())
+        return;
+
+    Level& cells = resetCells(snapshot.width(), snapshot.height(), true);
+    for(size_t slice = 0; slice < snapshot.slicesCount(); ++slice)
+    {
+        const SnapshotSliceEntry& entry = snapshot.slice(slice);
+        for(size_t row = 0; row < entry.m_rows; ++row)
+        {
+            const double* values = snapshot.row(slice, row);
+            float* mean = &cells.m_mean[(entry.m_globalY + row) * cells.m_width + entry.m_globalX];
+            for(size_t column = 0; column < entry.m_stride; ++column)
+                mean[column] = static_cast<float>(values[column]);
+        }
+    }
+    cells.m_minimum = cells.m_mean;
+    cells.m_maximum = cells.m_mean;
+    buildLevels();
+}
+
+bool DensityPyramid::valueRange(const size_t x0, const size_t y0, const size_t x1, const size_t y1,
+                                float& minimum, float& maximum) const
+{
+    if(!m_heatmap || empty() || x0 >= x1 || y0 >= y1)
+        return false;
+
+    size_t levelIndex = 0;
+    const size_t side = std::max(x1 - x0, y1 - y0);
+    while((side >> levelIndex) > RANGE_BLOCKS && levelIndex + 1 < m_levelsCount)
+        ++levelIndex;
+
+    const Level& level = m_levels[levelIndex];
+    const size_t lastX = std::min(level.m_width, ((x1 - 1) >> levelIndex) + 1);
+    const size_t lastY = std::min(level.m_height, ((y1 - 1) >> levelIndex) + 1);
+
+    minimum = level.m_minimum[(y0 >> levelIndex) * level.m_width + (x0 >> levelIndex)];
+    maximum = level.m_maximum[(y0 >> levelIndex) * level.m_width + (x0 >> levelIndex)];
+    for(size_t y = y0 >> levelIndex; y < lastY; ++y)
+        for(size_t x = x0 >> levelIndex; x < lastX; ++x)
+        {
+            minimum = std::min(minimum, level.m_minimum[y * level.m_width + x]);
+            maximum = std::max(maximum, level.m_maximum[y * level.m_width + x]);
+        }
+    return true;
+}
+
+DensityPyramid::Level& DensityPyramid::resetCells(const size_t width, const size_t height, const bool heatmap)
+{
+    if(m_levels.empty())
+        m_levels.resize(1);
+
+    Level& cells = m_levels.front();
+    cells.m_width = width;
+    cells.m_height = height;
+    if(heatmap)
+        cells.m_mean.resize(width * height);
+    else
+        cells.m_density.resize(width * height);
+    m_heatmap = heatmap;
+    m_levelsCount = 1;
+    return cells;
+}
+
+void DensityPyramid::buildLevels()
+{
+    while(m_levels[m_levelsCount - 1].m_width > 1 || m_levels[m_levelsCount - 1].m_height > 1)
+    {
+        if(m_levels.size() == m_levelsCount)
+            m_levels.resize(m_levelsCount + 1);
+
+        const Level& source = m_levels[m_levelsCount - 1];
+        Level& level = m_levels[m_levelsCount];
+        level.m_width = (source.m_width + 1) / 2;
+        level.m_height = (source.m_height + 1) / 2;
+
+        if(m_heatmap)
+            buildValueLevel(m_levelsCount - 1, level);
+        else
+            buildDensityLevel(source, level);
+        ++m_levelsCount;
+    }
+}
+
+void DensityPyramid::buildDensityLevel(const Level& source, Level& level)
+{
+    level.m_density.resize(level.m_width * level.m_height);
+
+    //Клетки за краем нечетного уровня считаются мертвыми
+    for(size_t y = 0; y < level.m_height; ++y)
+    {
+        const size_t sourceY = 2 * y;
+        const bool lowerExists = sourceY + 1 < source.m_height;
+        for(size_t x = 0; x < level.m_width; ++x)
+        {
+            const size_t sourceX = 2 * x;
+            const bool rightExists = sourceX + 1 < source.m_width;
+            const uint8_t* upper = &source.m_density[sourceY * source.m_width + sourceX];
+
+            unsigned sum = upper[0];
+            if(rightExists)
+                sum += upper[1];
+            if(lowerExists)
+            {
+                const uint8_t* lower = upper + source.m_width;
+                sum += lower[0] + (rightExists ? lower[1] : 0);
+            }
+            level.m_density[y * level.m_width + x] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+    }
+}
+
+void DensityPyramid::buildValueLevel(const size_t sourceIndex, Level& level)
+{
+    const Level& source = m_levels[sourceIndex];
+    const size_t width = m_levels.front().m_width;
+    const size_t height = m_levels.front().m_height;
+
+    level.m_mean.resize(level.m_width * level.m_height);
+    level.m_minimum.resize(level.m_width * level.m_height);
+    level.m_maximum.resize(level.m_width * level.m_height);
+
+    //За краем нечетного уровня значений нет - блок считается по существующим элементам,
+    //среднее взвешивается количеством клеток поля под элементом (у края блоки неполные)
+    for(size_t y = 0; y < level.m_height; ++y)
+    {
+        const size_t lastSourceY = std::min(2 * y + 2, source.m_height);
+        for(size_t x = 0; x < level.m_width; ++x)
+        {
+            const size_t lastSourceX = std::min(2 * x + 2, source.m_width);
+            const size_t first = 2 * y * source.m_width + 2 * x;
+
+            double sum = 0;
+            float minimum = source.m_minimum[first];
+            float maximum = source.m_maximum[first];
+            size_t count = 0;
+            for(size_t sourceY = 2 * y; sourceY < lastSourceY; ++sourceY)
+            {
+                const size_t cellsY = std::min(height - (sourceY << sourceIndex), size_t{1} << sourceIndex);
+                for(size_t sourceX = 2 * x; sourceX < lastSourceX; ++sourceX)
+                {
+                    const size_t cellsX = std::min(width - (sourceX << sourceIndex), size_t{1} << sourceIndex);
+                    const size_t index = sourceY * source.m_width + sourceX;
+                    sum += static_cast<double>(source.m_mean[index]) * cellsX * cellsY;
+                    minimum = std::min(minimum, source.m_minimum[index]);
+                    maximum = std::max(maximum, source.m_maximum[index]);
+                    count += cellsX * cellsY;
+                }
+            }
+
+            const size_t index = y * level.m_width + x;
+            level.m_mean[index] = static_cast<float>(sum / count);
+            level.m_minimum[index] = minimum;
+            level.m_maximum[index] = maximum;
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef DENSITYPYRAMID_H
+#define DENSITYPYRAMID_H
+
+#include "lab2types.h"
+#include "slice.h"
+#include "snapshot.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef BasicField<double> ValueField;//!< Поле значений (решение labM4)
+
+/*!
+ * \brief Пирамида уровней детализации поля. Каждый следующий уровень вдвое меньше по обеим сторонам.
+ * Поле клеток (labM2): уровень хранит долю живых клеток (0..255) в блоках 2^level x 2^level.
+ * Поле значений (labM4): уровень хранит среднее, минимум и максимум значений в блоках,
+ * что позволяет быстро найти диапазон значений любой области для автомасштабирования цвета.
+ * Память уровней переиспользуется при повторном построении.
+ */
+struct DensityPyramid
+{
+    struct Level
+    {
+        size_t m_width;
+        size_t m_height;
+        std::vector<uint8_t> m_density;//!< Доля живых клеток (поле клеток)
+        std::vector<float> m_mean;//!< Среднее значение (поле значений)
+        std::vector<float> m_minimum;
+        std::vector<float> m_maximum;
+    };
+
+    DensityPyramid():
+        m_levelsCount{0},
+        m_heatmap{false}
+    {}
+
+    /*!
+     * \brief Строит пирамиду по собранному полю клеток
+     */
+    void fromField(const Field& field);
+
+    /*!
+     * \brief Строит пирамиду по клеткам поля, записанным построчно
+     */
+    void fromCells(const values_t* cells, const size_t width, const size_t height);
+
+    /*!
+     * \brief Строит пирамиду по снимку поля клеток, читая строки прямо из отображенного файла
+     */
+    void fromSnapshot(const SnapshotView<values_t>& snapshot);
+
+    /*!
+     * \brief Строит пирамиду по собранному полю значений
+     */
+    void fromValueField(const ValueField& field);
+
+    /*!
+     * \brief Строит пирамиду по снимку поля значений
+     */
+    void fromValueSnapshot(const SnapshotView<double>& snapshot);
+
+    /*!
+     * \brief Диапазон значений в прямоугольнике поля значений.
+     * Берется по блокам грубого уровня, поэтому может быть немного шире точного.
+     * \param x0 левая граница (включительно)
+     * \param y0 верхняя граница (включительно)
+     * \param x1 правая граница (не включительно)
+     * \param y1 нижняя граница (не включительно)
+     * \param minimum минимальное значение
+     * \param maximum максимальное значение
+     * \return false если прямоугольник пуст
+     */
+    bool valueRange(const size_t x0, const size_t y0, const size_t x1, const size_t y1,
+                    float& minimum, float& maximum) const;
+
+    void clear()
+    {
+        m_levelsCount = 0;
+    }
+
+    bool empty() const
+    {
+        return !m_levelsCount;
+    }
+
+    bool heatmap() const
+    {
+        return m_heatmap;
+    }
+
+    size_t levels() const
+    {
+        return m_levelsCount;
+    }
+
+    const Level& level(const size_t index) const
+    {
+        return m_levels[index];
+    }
+
+    size_t width() const
+    {
+        return empty() ? 0 : m_levels.front().m_width;
+    }
+
+    size_t height() const
+    {
+        return empty() ? 0 : m_levels.front().m_height;
+    }
+
+private:
+    Level& resetCells(const size_t width, const size_t height, const bool heatmap);
+    void buildLevels();
+    void buildDensityLevel(const Level& source, Level& level);
+    void buildValueLevel(const size_t sourceIndex, Level& level);
+
+    std::vector<Level> m_levels;
+    size_t m_levelsCount;//!< Количество действительных уровней (остальные - запас памяти)
+    bool m_heatmap;//!< Пирамида построена по полю значений
+};
+
+#endif // DENSITYPYRAMID_H
@@ -0,0 +1,131 @@
+#include "fieldloader.h"
+
+#include "slice.h"
+
+#include <QMetaObject>
+#include <QTimer>
+
+#include <fstream>
+#include <utility>
+
+namespace
+{
+    const int LIVE_FEED_POLL_INTERVAL = 10;//!< Период опроса разделяемой памяти в мс
+}
+
+FieldLoader::FieldLoader(const QString& fileName, const bool heatmap, QObject *parent) :
+    QObject(parent),
+    m_fileName(fileName),
+    m_heatmap(heatmap),
+    m_liveFeedTimer(nullptr),
+    m_lastFrame(0),
+    m_readyFresh(false),
+    m_fileRequested(false),
+    m_frameSignalled(false)
+{}
+
+void FieldLoader::start()
+{
+    if(m_heatmap)
+        return;
+
+    m_liveFeedTimer = new QTimer(this);
+    connect(m_liveFeedTimer, &QTimer::timeout, this, &FieldLoader::pollLiveFeed);
+    m_liveFeedTimer->start(LIVE_FEED_POLL_INTERVAL);
+}
+
+void FieldLoader::requestFile()
+{
+    if(!m_fileRequested.exchange(true))
+        QMetaObject::invokeMethod(this, "loadFile", Qt::QueuedConnection);
+}
+
+bool FieldLoader::takeFrame(DensityPyramid& pyramid)
+{
+    m_frameSignalled = false;
+
+    std::lock_guard<std::mutex> lock(m_readyMutex);
+    if(!m_readyFresh)
+        return false;
+
+    std::swap(pyramid, m_ready);
+    m_readyFresh = false;
+    return true;
+}
+
+void FieldLoader::loadFile()
+{
+    //Изменения файла, пришедшие после этой точки, вызовут еще одно чтение
+    m_fileRequested = false;
+
+    try
+    {
+        //Снимок отображается в память и читается без разбора; тип значений записан в заголовке
+        const std::string fileName = m_fileName.toStdString();
+        const uint32_t valueSize = snapshotValueSize(fileName);
+        if(valueSize == sizeof(values_t))
+        {
+            m_loading.fromSnapshot(SnapshotView<values_t>(fileName));
+            publish();
+            return;
+        }
+        if(valueSize == sizeof(double))
+        {
+            m_loading.fromValueSnapshot(SnapshotView<double>(fileName));
+            publish();
+            return;
+        }
+
+        std::ifstream is(fileName, std::ios::binary);
+        boost::archive::binary_iarchive iar(is);
+        if(m_heatmap)
+        {
+            ValueField field;
+            iar >> field;
+            m_loading.fromValueField(field);
+        }
+        else
+        {
+            Field field;
+            iar >> field;
+            m_loading.fromField(field);
+        }
+        publish();
+    }
+    catch(...)
+    {
+        //Файл еще дописывается - покажем его после следующего изменения
+    }
+}
+
+void FieldLoader::pollLiveFeed()
+{
+    //labM2 пересоздает буфер при каждом запуске
+    if(!m_liveFeed.attached() || m_liveFeed.replaced())
+    {
+        if(!m_liveFeed.attach())
+            return;
+        m_lastFrame = 0;
+    }
+
+    //Пирамида строится прямо из разделяемой памяти; разорванный кадр не показывается
+    const bool frameRead = m_liveFeed.readLatest(m_lastFrame,
+        [this](const values_t* cells, const size_t width, const size_t height, const uint64_t)
+        {
+            m_loading.fromCells(cells, width, height);
+        });
+    if(frameRead)
+        publish();
+}
+
+void FieldLoader::publish()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_readyMutex);
+        std::swap(m_loading, m_ready);
+        m_readyFresh = true;
+    }
+
+    if(!m_frameSignalled.exchange(true))
+        emit frameReady();
+}
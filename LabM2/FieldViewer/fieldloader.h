@@ -0,0 +1,82 @@
+#ifndef FIELDLOADER_H
+#define FIELDLOADER_H
+
+#include "densitypyramid.h"
+#include "livefeed.h"
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+class QTimer;
+
+/*!
+ * \brief Загрузчик кадров, работающий в отдельном потоке.
+ * Читает файл поля по запросу и опрашивает разделяемую память labM2, строит пирамиду плотностей
+ * и кладет ее в ячейку готового кадра. Хранится только самый новый кадр: если интерфейс
+ * не успел забрать предыдущий, он заменяется. Повторные запросы чтения файла,
+ * пришедшие во время разбора, сливаются в одно чтение.
+ * В режиме тепловой карты файл содержит поле значений labM4, разделяемая память не опрашивается.
+ * Файл снимка (snapshot.h) распознается по заголовку, тип его значений определяется автоматически.
+ */
+class FieldLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * \brief Конструктор
+     * \param fileName файл поля
+     * \param heatmap файл содержит поле значений (double), а не клеток
+     */
+    FieldLoader(const QString& fileName, const bool heatmap, QObject *parent = 0);
+
+    /*!
+     * \brief Просит перечитать файл (из любого потока)
+     */
+    void requestFile();
+
+    /*!
+     * \brief Забирает готовый кадр, обменивая его с переданной пирамидой (поток интерфейса)
+     * \return true если был новый кадр
+     */
+    bool takeFrame(DensityPyramid& pyramid);
+
+public slots:
+    /*!
+     * \brief Запускает опрос разделяемой памяти (вызывается в потоке загрузчика)
+     */
+    void start();
+
+signals:
+    /*!
+     * \brief Появился новый кадр (не повторяется, пока кадр не забран)
+     */
+    void frameReady();
+
+private slots:
+    void loadFile();
+    void pollLiveFeed();
+
+private:
+    void publish();
+
+    const QString m_fileName;
+    const bool m_heatmap;
+    QTimer* m_liveFeedTimer;
+    LiveFeedReader m_liveFeed;
+    uint64_t m_lastFrame;//!< Номер последнего прочитанного кадра из разделяемой памяти
+    DensityPyramid m_loading;//!< Строящийся кадр (только поток загрузчика)
+
+    std::mutex m_readyMutex;
+    DensityPyramid m_ready;//!< Готовый кадр
+    bool m_readyFresh;//!< Готовый кадр еще не забран
+
+    std::atomic<bool> m_fileRequested;//!< Чтение файла уже поставлено в очередь
+    std::atomic<bool> m_frameSignalled;//!< Сигнал о готовом кадре уже отправлен
+};
+
+#endif // FIELDLOADER_H
@@ -0,0 +1,258 @@
+#include "fieldview.h"
+
+#include <QFontMetrics>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+    const double MIN_SCALE = 1.0 / 4096;//!< Минимальный масштаб (пикселей на клетку)
+    const double MAX_SCALE = 64.0;//!< Максимальный масштаб
+    const double ZOOM_STEP = 1.25;//!< Изменение масштаба на один щелчок колеса
+    const double GRID_MIN_SCALE = 8.0;//!< Начиная с этого масштаба рисуется сетка
+    const QRgb OUTSIDE_COLOR = qRgb(160, 160, 160);//!< Цвет области вне поля
+    const QRgb GRID_COLOR = qRgb(210, 210, 210);
+    const int LEGEND_MARGIN = 8;//!< Отступ подписи диапазона значений от края виджета
+
+    /*!
+     * \brief Цвет тепловой карты: синий - голубой - зеленый - желтый - красный
+     * \param position положение в шкале (0..1)
+     */
+    QRgb heatColor(const double position)
+    {
+        const double red = std::min(1.0, std::max(0.0, 1.5 - std::fabs(4 * position - 3)));
+        const double green = std::min(1.0, std::max(0.0, 1.5 - std::fabs(4 * position - 2)));
+        const double blue = std::min(1.0, std::max(0.0, 1.5 - std::fabs(4 * position - 1)));
+        return qRgb(static_cast<int>(255 * red), static_cast<int>(255 * green), static_cast<int>(255 * blue));
+    }
+}
+
+FieldView::FieldView(QWidget *parent) :
+    QWidget(parent),
+    m_scale{1.0},
+    m_dragging{false},
+    m_fitted{false},
+    m_minimum{0},
+    m_maximum{0},
+    m_rangeScale{0}
+{
+    //Плотность 0 - белый, 255 - черный; тепловая карта - от синего к красному
+    for(int density = 0; density < 256; ++density)
+    {
+        m_palette[density] = qRgb(255 - density, 255 - density, 255 - density);
+        m_heatPalette[density] = heatColor(density / 255.0);
+    }
+
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+void FieldView::swapPyramid(DensityPyramid& pyramid)
+{
+    const bool sizeChanged = m_pyramid.width() != pyramid.width() || m_pyramid.height() != pyramid.height();
+    std::swap(m_pyramid, pyramid);
+
+    if(sizeChanged || !m_fitted)
+        fitToView();
+    update();
+}
+
+void FieldView::fitToView()
+{
+    if(m_pyramid.empty() || width() <= 0 || height() <= 0)
+        return;
+
+    const double fieldWidth = m_pyramid.width();
+    const double fieldHeight = m_pyramid.height();
+    m_scale = std::max(MIN_SCALE, std::min(MAX_SCALE, std::min(width() / fieldWidth, height() / fieldHeight)));
+    m_origin = QPointF((fieldWidth - width() / m_scale) / 2, (fieldHeight - height() / m_scale) / 2);
+    m_fitted = true;
+    update();
+}
+
+size_t FieldView::levelForScale() const
+{
+    //Уровень, в котором один элемент не больше пикселя окна
+    if(m_scale >= 1.0)
+        return 0;
+    const size_t level = static_cast<size_t>(std::floor(std::log2(1.0 / m_scale)));
+    return std::min(level, m_pyramid.levels() - 1);
+}
+
+void FieldView::paintEvent(QPaintEvent*)
+{
+    if(m_frame.size() != size())
+        m_frame = QImage(size(), QImage::Format_RGB32);
+
+    if(m_pyramid.empty())
+        m_frame.fill(OUTSIDE_COLOR);
+    else
+    {
+        const size_t levelIndex = levelForScale();
+        const DensityPyramid::Level& level = m_pyramid.level(levelIndex);
+        const double fieldWidth = m_pyramid.width();
+        const double fieldHeight = m_pyramid.height();
+        if(m_pyramid.heatmap())
+            updateValueRange();
+
+        m_columns.resize(width());
+        for(int column = 0; column < width(); ++column)
+        {
+            const double fieldX = m_origin.x() + (column + 0.5) / m_scale;
+            m_columns[column] = (fieldX < 0 || fieldX >= fieldWidth) ? -1 : static_cast<int>(fieldX) >> levelIndex;
+        }
+
+        for(int row = 0; row < height(); ++row)
+        {
+            QRgb* line = reinterpret_cast<QRgb*>(m_frame.scanLine(row));
+            const double fieldY = m_origin.y() + (row + 0.5) / m_scale;
+            if(fieldY < 0 || fieldY >= fieldHeight)
+            {
+                std::fill(line, line + width(), OUTSIDE_COLOR);
+                continue;
+            }
+
+            const size_t levelRow = (static_cast<size_t>(fieldY) >> levelIndex) * level.m_width;
+            if(m_pyramid.heatmap())
+            {
+                const float* mean = &level.m_mean[levelRow];
+                for(int column = 0; column < width(); ++column)
+                {
+                    if(m_columns[column] < 0)
+                    {
+                        line[column] = OUTSIDE_COLOR;
+                        continue;
+                    }
+                    const float position = (mean[m_columns[column]] - m_minimum) * m_rangeScale;
+                    line[column] = m_heatPalette[std::min(255, std::max(0, static_cast<int>(position)))];
+                }
+            }
+            else
+            {
+                const uint8_t* density = &level.m_density[levelRow];
+                for(int column = 0; column < width(); ++column)
+                    line[column] = m_columns[column] < 0 ? OUTSIDE_COLOR : m_palette[density[m_columns[column]]];
+            }
+        }
+    }
+
+    QPainter painter(this);
+    painter.drawImage(0, 0, m_frame);
+    if(!m_pyramid.empty() && m_scale >= GRID_MIN_SCALE)
+        drawGrid(painter);
+    if(m_pyramid.heatmap())
+        drawLegend(painter);
+}
+
+void FieldView::updateValueRange()
+{
+    //Шкала растягивается на диапазон значений видимой части поля
+    const double fieldWidth = m_pyramid.width();
+    const double fieldHeight = m_pyramid.height();
+    const size_t x0 = static_cast<size_t>(std::max(0.0, m_origin.x()));
+    const size_t y0 = static_cast<size_t>(std::max(0.0, m_origin.y()));
+    const size_t x1 = static_cast<size_t>(std::ceil(std::min(fieldWidth, m_origin.x() + width() / m_scale)));
+    const size_t y1 = static_cast<size_t>(std::ceil(std::min(fieldHeight, m_origin.y() + height() / m_scale)));
+
+    if(!m_pyramid.valueRange(x0, y0, x1, y1, m_minimum, m_maximum))
+        m_minimum = m_maximum = 0;
+    m_rangeScale = m_maximum > m_minimum ? 256 / (m_maximum - m_minimum) : 0;
+}
+
+void FieldView::drawLegend(QPainter& painter) const
+{
+    const QString text = QString("%1 .. %2").arg(m_minimum, 0, 'g', 6).arg(m_maximum, 0, 'g', 6);
+    const QRect textRect = painter.fontMetrics().boundingRect(text).adjusted(-4, -2, 4, 2);
+    const QRect legendRect(LEGEND_MARGIN, height() - LEGEND_MARGIN - textRect.height(),
+                           textRect.width(), textRect.height());
+
+    painter.fillRect(legendRect, QColor(255, 255, 255, 200));
+    painter.setPen(Qt::black);
+    painter.drawText(legendRect, Qt::AlignCenter, text);
+}
+
+void FieldView::drawGrid(QPainter& painter) const
+{
+    const double fieldWidth = m_pyramid.width();
+    const double fieldHeight = m_pyramid.height();
+    const double firstX = std::max(0.0, std::ceil(m_origin.x()));
+    const double lastX = std::min(fieldWidth, m_origin.x() + width() / m_scale);
+    const double firstY = std::max(0.0, std::ceil(m_origin.y()));
+    const double lastY = std::min(fieldHeight, m_origin.y() + height() / m_scale);
+    const double top = (std::max(0.0, m_origin.y()) - m_origin.y()) * m_scale;
+    const double bottom = (std::min(fieldHeight, m_origin.y() + height() / m_scale) - m_origin.y()) * m_scale;
+    const double left = (std::max(0.0, m_origin.x()) - m_origin.x()) * m_scale;
+    const double right = (std::min(fieldWidth, m_origin.x() + width() / m_scale) - m_origin.x()) * m_scale;
+
+    painter.setPen(QColor(GRID_COLOR));
+    for(double x = firstX; x <= lastX; ++x)
+    {
+        const double screenX = (x - m_origin.x()) * m_scale;
+        painter.drawLine(QPointF(screenX, top), QPointF(screenX, bottom));
+    }
+    for(double y = firstY; y <= lastY; ++y)
+    {
+        const double screenY = (y - m_origin.y()) * m_scale;
+        painter.drawLine(QPointF(left, screenY), QPointF(right, screenY));
+    }
+}
+
+void FieldView::zoom(const double factor, const QPointF& anchor)
+{
+    //Точка поля под курсором остается на месте
+    const QPointF fieldPoint = m_origin + anchor / m_scale;
+    m_scale = std::max(MIN_SCALE, std::min(MAX_SCALE, m_scale * factor));
+    m_origin = fieldPoint - anchor / m_scale;
+    update();
+}
+
+void FieldView::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    if(!m_fitted)
+        fitToView();
+}
+
+void FieldView::wheelEvent(QWheelEvent* event)
+{
+    zoom(std::pow(ZOOM_STEP, event->angleDelta().y() / 120.0), event->posF());
+    event->accept();
+}
+
+void FieldView::mousePressEvent(QMouseEvent* event)
+{
+    if(event->button() == Qt::LeftButton)
+    {
+        m_dragging = true;
+        m_dragStart = event->pos();
+        setCursor(Qt::ClosedHandCursor);
+    }
+}
+
+void FieldView::mouseMoveEvent(QMouseEvent* event)
+{
+    if(!m_dragging)
+        return;
+
+    m_origin -= QPointF(event->pos() - m_dragStart) / m_scale;
+    m_dragStart = event->pos();
+    update();
+}
+
+void FieldView::mouseReleaseEvent(QMouseEvent* event)
+{
+    if(event->button() == Qt::LeftButton)
+    {
+        m_dragging = false;
+        unsetCursor();
+    }
+}
+
+void FieldView::mouseDoubleClickEvent(QMouseEvent*)
+{
+    fitToView();
+}
@@ -0,0 +1,70 @@
+#ifndef FIELDVIEW_H
+#define FIELDVIEW_H
+
+#include "densitypyramid.h"
+
+#include <QImage>
+#include <QPoint>
+#include <QPointF>
+#include <QWidget>
+
+#include <vector>
+
+/*!
+ * \brief Виджет, рисующий поле через QImage.
+ * Рисуется только видимая часть поля: каждый пиксель окна берется из одного уровня пирамиды плотностей,
+ * поэтому время кадра зависит от размера окна, а не от размера поля.
+ * Поле значений рисуется тепловой картой, шкала которой растягивается на диапазон видимой части.
+ * Колесо мыши - масштаб, перетаскивание - сдвиг, двойной щелчок - поле целиком.
+ */
+class FieldView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit FieldView(QWidget *parent = 0);
+
+    /*!
+     * \brief Показывает новое поле, обменивая пирамиду виджета с переданной (без копирования).
+     * При неизменном размере поля положение просмотра сохраняется.
+     * \param pyramid пирамида нового поля (после вызова содержит пирамиду предыдущего)
+     */
+    void swapPyramid(DensityPyramid& pyramid);
+
+    /*!
+     * \brief Масштаб и сдвиг, при которых поле целиком помещается в виджет
+     */
+    void fitToView();
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+
+private:
+    size_t levelForScale() const;
+    void zoom(double factor, const QPointF& anchor);
+    void drawGrid(QPainter& painter) const;
+    void updateValueRange();
+    void drawLegend(QPainter& painter) const;
+
+    DensityPyramid m_pyramid;
+    double m_scale;//!< Пикселей окна на клетку поля
+    QPointF m_origin;//!< Координаты поля в левом верхнем углу виджета
+    QPoint m_dragStart;
+    bool m_dragging;
+    bool m_fitted;//!< Было ли поле хоть раз вписано в окно
+    QImage m_frame;//!< Кадр (пересоздается только при изменении размера виджета)
+    QRgb m_palette[256];//!< Цвета плотностей
+    QRgb m_heatPalette[256];//!< Цвета тепловой карты
+    float m_minimum;//!< Значение, соответствующее началу шкалы тепловой карты
+    float m_maximum;//!< Значение, соответствующее концу шкалы
+    float m_rangeScale;//!< Элементов шкалы на единицу значения
+    std::vector<int> m_columns;//!< Столбец уровня для каждого столбца кадра (-1 - вне поля)
+};
+
+#endif // FIELDVIEW_H
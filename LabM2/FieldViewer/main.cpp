@@ -1,10 +1,18 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QStringList>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
-    MainWindow w;
+
+    //FieldViewer [--heatmap] [файл поля или снимок]
+    QStringList arguments = a.arguments();
+    arguments.removeFirst();
+    const bool heatmap = arguments.removeAll("--heatmap") > 0;
+    const QString fileName = arguments.isEmpty() ? QString("field.dat") : arguments.first();
+
+    MainWindow w(fileName, heatmap);
     w.show();
 
     return a.exec();
@@ -1,21 +1,20 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
-#include "lab2types.h"
-#include "extendedslice.h"
+#include "fieldloader.h"
+
 #include <QDebug>
 #include <QStyle>
 #include <QDesktopWidget>
-#include <QTableWidget>
 #include <QFileSystemWatcher>
+#include <QTimer>
 
-#include <vector>
-#include <iostream>
-#include <fstream>
+const int FILE_CHANGE_DELAY = 30;//!< Через сколько мс после первого уведомления об изменении файл читается
 
-MainWindow::MainWindow(QWidget *parent) :
+MainWindow::MainWindow(const QString& fileName, const bool heatmap, QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    m_fileName(fileName)
 {
     ui->setupUi(this);
     setGeometry(QStyle::alignedRect(Qt::LeftToRight,
@@ -25,56 +24,52 @@ MainWindow::MainWindow(QWidget *parent) :
                                     )
                 );
 
-    updateTable();
+    //Разбор файла и построение пирамиды выполняются в потоке загрузчика
+    m_loader = new FieldLoader(m_fileName, heatmap);
+    m_loader->moveToThread(&m_loaderThread);
+    connect(&m_loaderThread, &QThread::started, m_loader, &FieldLoader::start);
+    connect(&m_loaderThread, &QThread::finished, m_loader, &QObject::deleteLater);
+    connect(m_loader, &FieldLoader::frameReady, this, &MainWindow::showFrame, Qt::QueuedConnection);
+    m_loaderThread.start();
+
+    //Уведомления об изменении файла за интервал сливаются в одно чтение
+    m_fileChangeTimer = new QTimer(this);
+    m_fileChangeTimer->setSingleShot(true);
+    m_fileChangeTimer->setInterval(FILE_CHANGE_DELAY);
+    connect(m_fileChangeTimer, &QTimer::timeout, this, &MainWindow::updateField);
 
     m_fileSystemWatcher = new QFileSystemWatcher(this);
-    m_fileSystemWatcher->addPath("./field.dat");
-    connect(m_fileSystemWatcher, &QFileSystemWatcher::fileChanged, this, &MainWindow::updateTable);
+    m_fileSystemWatcher->addPath(m_fileName);
+    connect(m_fileSystemWatcher, &QFileSystemWatcher::fileChanged, this, &MainWindow::scheduleUpdate);
+
+    updateField();
 }
 
 MainWindow::~MainWindow()
 {
+    m_loaderThread.quit();
+    m_loaderThread.wait();
     delete ui;
 }
 
-void MainWindow::updateTable()
+void MainWindow::scheduleUpdate()
 {
-    try
-    {
-        std::ifstream is("field.dat", std::ios::binary);
-        boost::archive::binary_iarchive iar(is);
-        Field field;
-        iar >> field;
+    //Таймер не перезапускается: при непрерывной записи кадр читается не реже раза в FILE_CHANGE_DELAY мс
+    if(!m_fileChangeTimer->isActive())
+        m_fileChangeTimer->start();
+}
 
-        ui->tableWidget->setRowCount(0);
-        ui->tableWidget->setRowCount(field.m_height);
-        ui->tableWidget->setColumnCount(field.m_width);
+void MainWindow::updateField()
+{
+    //Файл мог быть пересоздан - тогда наблюдение за ним снимается
+    if(!m_fileSystemWatcher->files().contains(m_fileName))
+        m_fileSystemWatcher->addPath(m_fileName);
 
-        for(Slice& slice : field.m_slices)
-        {
-            int x = slice.m_globalX;
-            int y = slice.m_globalY;
-            for(values_t& value : slice.m_values)
-            {
-                if(value)
-                {
-                    QTableWidgetItem *newItem = new QTableWidgetItem("*");
-                    newItem->setTextAlignment(Qt::AlignCenter);
-                    ui->tableWidget->setItem(y, x, newItem);
-                }
-                ++x;
-                if(x == static_cast<int>(slice.m_globalX + slice.m_stride))
-                {
-                    x = slice.m_globalX;
-                    ++y;
-                }
-            }
-        }
+    m_loader->requestFile();
+}
 
-        ui->tableWidget->resizeColumnsToContents();
-        ui->tableWidget->resizeRowsToContents();
-    }
-    catch(...)
-    {
-    }
+void MainWindow::showFrame()
+{
+    if(m_loader->takeFrame(m_pyramid))
+        ui->fieldView->swapPyramid(m_pyramid);
 }
@@ -1,9 +1,14 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "densitypyramid.h"
+
 #include <QMainWindow>
+#include <QThread>
 
 class QFileSystemWatcher;
+class QTimer;
+class FieldLoader;
 
 namespace Ui {
 class MainWindow;
@@ -14,14 +19,26 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = 0);
+    /*!
+     * \brief Конструктор
+     * \param fileName файл поля
+     * \param heatmap показывать поле значений labM4 тепловой картой
+     */
+    MainWindow(const QString& fileName, const bool heatmap, QWidget *parent = 0);
     ~MainWindow();
 
-    void updateTable();
+    void scheduleUpdate();
+    void updateField();
+    void showFrame();
 
 private:
     Ui::MainWindow *ui;
+    const QString m_fileName;
     QFileSystemWatcher* m_fileSystemWatcher;
+    QTimer* m_fileChangeTimer;//!< Сливает уведомления об изменении файла в одно чтение за интервал
+    QThread m_loaderThread;
+    FieldLoader* m_loader;//!< Загрузчик кадров (живет в m_loaderThread)
+    DensityPyramid m_pyramid;//!< Буфер для обмена кадрами с загрузчиком
 };
 
 #endif // MAINWINDOW_H
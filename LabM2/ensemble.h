@@ -0,0 +1,143 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*!
+ * \brief Набор независимых маленьких периодических полей одинакового размера.
+ * Клетки хранятся с чередованием по полям (клетка (x, y) всех полей подряд), поэтому
+ * шаг игры для всех полей выполняется одним векторизуемым циклом и не требует обменов.
+ */
+struct LifeEnsemble
+{
+    /*!
+     * \brief Конструктор
+     * \param width ширина каждого поля
+     * \param height высота каждого поля
+     * \param count количество полей
+     */
+    LifeEnsemble(const size_t width, const size_t height, const size_t count):
+        m_width{width},
+        m_height{height},
+        m_count{count},
+        m_cells(width * height * count, 0),
+        m_nextCells(width * height * count, 0),
+        m_changed(count, 0),
+        m_lastChange(count, 0)
+    {}
+
+    /*!
+     * \brief Случайно заполняет одно поле
+     * \param universe номер поля
+     * \param seed зерно генератора (поле воспроизводится по зерну независимо от процесса)
+     * \param density доля живых клеток
+     */
+    void randomize(const size_t universe, uint64_t seed, const double density)
+    {
+        const uint64_t threshold = static_cast<uint64_t>(density * 18446744073709551615.);
+        for(size_t cell = 0; cell < m_width * m_height; ++cell)
+        {
+            //splitmix64
+            uint64_t random = (seed += 0x9e3779b97f4a7c15ull);
+            random = (random ^ (random >> 30)) * 0xbf58476d1ce4e5b9ull;
+            random = (random ^ (random >> 27)) * 0x94d049bb133111ebull;
+            random ^= random >> 31;
+
+            m_cells[cell * m_count + universe] = random < threshold ? 1 : 0;
+        }
+    }
+
+    /*!
+     * \brief Один шаг игры во всех полях
+     * \param generation номер получаемого поколения (запоминается для изменившихся полей)
+     * \return true если изменилось хотя бы одно поле
+     */
+    bool step(const uint32_t generation)
+    {
+        std::fill(m_changed.begin(), m_changed.end(), 0);
+
+        for(size_t y = 0; y < m_height; ++y)
+        {
+            const size_t upperY = (y + m_height - 1) % m_height;
+            const size_t lowerY = (y + 1) % m_height;
+
+            for(size_t x = 0; x < m_width; ++x)
+            {
+                const size_t leftX = (x + m_width - 1) % m_width;
+                const size_t rightX = (x + 1) % m_width;
+
+                const values_t* __restrict upperLeft = cells(leftX, upperY);
+                const values_t* __restrict upper = cells(x, upperY);
+                const values_t* __restrict upperRight = cells(rightX, upperY);
+                const values_t* __restrict left = cells(leftX, y);
+                const values_t* __restrict middle = cells(x, y);
+                const values_t* __restrict right = cells(rightX, y);
+                const values_t* __restrict lowerLeft = cells(leftX, lowerY);
+                const values_t* __restrict lower = cells(x, lowerY);
+                const values_t* __restrict lowerRight = cells(rightX, lowerY);
+                values_t* __restrict next = &m_nextCells[(y * m_width + x) * m_count];
+                values_t* __restrict changed = m_changed.data();
+
+                for(size_t universe = 0; universe < m_count; ++universe)
+                {
+                    const values_t aliveNeighbors = upperLeft[universe] + upper[universe] + upperRight[universe] +
+                                                    left[universe] + right[universe] +
+                                                    lowerLeft[universe] + lower[universe] + lowerRight[universe];
+                    const values_t alive = (aliveNeighbors == 3) | (middle[universe] & (aliveNeighbors == 2));
+                    changed[universe] |= alive ^ middle[universe];
+                    next[universe] = alive;
+                }
+            }
+        }
+
+        m_cells.swap(m_nextCells);
+
+        bool anyChanged = false;
+        for(size_t universe = 0; universe < m_count; ++universe)
+            if(m_changed[universe])
+            {
+                m_lastChange[universe] = generation;
+                anyChanged = true;
+            }
+        return anyChanged;
+    }
+
+    /*!
+     * \brief Последнее поколение, в котором изменялось каждое поле
+     */
+    const std::vector<uint32_t>& lastChanges() const
+    {
+        return m_lastChange;
+    }
+
+    /*!
+     * \brief Количество живых клеток в каждом поле
+     */
+    std::vector<uint32_t> populations() const
+    {
+        std::vector<uint32_t> result(m_count, 0);
+        for(size_t cell = 0; cell < m_width * m_height; ++cell)
+            for(size_t universe = 0; universe < m_count; ++universe)
+                result[universe] += m_cells[cell * m_count + universe];
+        return result;
+    }
+
+    const size_t m_width;
+    const size_t m_height;
+    const size_t m_count;//!< Количество полей
+
+private:
+    const values_t* cells(const size_t x, const size_t y) const
+    {
+        return &m_cells[(y * m_width + x) * m_count];
+    }
+
+    std::vector<values_t> m_cells;//!< Клетки всех полей ((y * m_width + x) * m_count + номер поля)
+    std::vector<values_t> m_nextCells;//!< Следующее поколение
+    std::vector<values_t> m_changed;//!< Признак изменения поля на текущем шаге
+    std::vector<uint32_t> m_lastChange;//!< Последнее поколение, в котором поле изменилось
+};
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,313 @@
+#ifndef LIVEFEED_H
+#define LIVEFEED_H
+
+#include "slice.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Live feed needs lock-free 64-bit atomics in shared memory");
+
+const char LIVE_FEED_NAME[] = "/labm2_field";//!< Имя объекта разделяемой памяти
+const uint32_t LIVE_FEED_MAGIC = 0x4c464544u;//!< Признак инициализированного буфера
+const uint32_t LIVE_FEED_VERSION = 1u;
+const size_t LIVE_FEED_SLOTS = 4u;//!< Количество кадров в кольцевом буфере
+const size_t LIVE_FEED_ALIGNMENT = 64u;//!< Выравнивание заголовков и кадров (строка кэша)
+
+/*!
+ * \brief Заголовок кольцевого буфера кадров.
+ * Кадр с номером n (с 1) пишется в ячейку n % m_slots. Номер ячейки (seqlock) нечетный, пока кадр
+ * пишется, и равен 2n после записи: читатель проверяет номер до и после чтения и отбрасывает
+ * кадр, если его перезаписали. Запись и чтение не блокируют друг друга.
+ */
+struct LiveFeedHeader
+{
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint64_t m_width;
+    uint64_t m_height;
+    uint64_t m_slots;
+    std::atomic<uint64_t> m_latest;//!< Номер последнего полностью записанного кадра (0 - кадров нет)
+};
+
+/*!
+ * \brief Заголовок ячейки кадра (за ним следуют m_width * m_height клеток поля построчно)
+ */
+struct LiveFeedSlot
+{
+    std::atomic<uint64_t> m_sequence;
+    uint64_t m_iteration;//!< Номер итерации, на которой снят кадр (с 1, растет на каждой итерации)
+};
+
+inline size_t liveFeedAligned(const size_t bytes)
+{
+    return (bytes + LIVE_FEED_ALIGNMENT - 1) / LIVE_FEED_ALIGNMENT * LIVE_FEED_ALIGNMENT;
+}
+
+inline size_t liveFeedSlotBytes(const size_t width, const size_t height)
+{
+    return liveFeedAligned(sizeof(LiveFeedSlot)) + liveFeedAligned(width * height * sizeof(values_t));
+}
+
+inline size_t liveFeedBytes(const size_t width, const size_t height, const size_t slots)
+{
+    return liveFeedAligned(sizeof(LiveFeedHeader)) + slots * liveFeedSlotBytes(width, height);
+}
+
+/*!
+ * \brief Публикация кадров поля в разделяемую память (главный процесс labM2)
+ */
+class LiveFeedWriter
+{
+public:
+    /*!
+     * \brief Создает (пересоздает) буфер
+     * \param width ширина поля
+     * \param height высота поля
+     */
+    LiveFeedWriter(const size_t width, const size_t height):
+        m_bytes{liveFeedBytes(width, height, LIVE_FEED_SLOTS)}
+    {
+        //Старый буфер может быть отображен наблюдателем - не усекаем его, а создаем новый
+        shm_unlink(LIVE_FEED_NAME);
+        m_file = shm_open(LIVE_FEED_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if(m_file < 0 || ftruncate(m_file, m_bytes) != 0)
+            throw std::runtime_error("Can not create live feed");
+
+        void* data = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+        if(data == MAP_FAILED)
+            throw std::runtime_error("Can not map live feed");
+        m_data = static_cast<char*>(data);
+
+        LiveFeedHeader* header = this->header();
+        header->m_version = LIVE_FEED_VERSION;
+        header->m_width = width;
+        header->m_height = height;
+        header->m_slots = LIVE_FEED_SLOTS;
+        header->m_latest.store(0, std::memory_order_relaxed);
+        for(size_t slot = 0; slot < LIVE_FEED_SLOTS; ++slot)
+            this->slot(slot)->m_sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header->m_magic = LIVE_FEED_MAGIC;
+    }
+
+    LiveFeedWriter(const LiveFeedWriter&) = delete;
+    LiveFeedWriter& operator=(const LiveFeedWriter&) = delete;
+
+    /*!
+     * \brief Удаляет имя буфера (уже подключенные читатели сохраняют последний кадр)
+     */
+    ~LiveFeedWriter()
+    {
+        munmap(m_data, m_bytes);
+        close(m_file);
+        shm_unlink(LIVE_FEED_NAME);
+    }
+
+    /*!
+     * \brief Публикует кадр
+     * \param field собранное поле
+     * \param iteration номер итерации
+     */
+    void publish(const Field& field, const uint64_t iteration)
+    {
+        LiveFeedHeader* header = this->header();
+        const uint64_t frame = header->m_latest.load(std::memory_order_relaxed) + 1;
+        LiveFeedSlot* slot = this->slot(frame % LIVE_FEED_SLOTS);
+
+        slot->m_sequence.store(2 * frame - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->m_iteration = iteration;
+        values_t* cells = slotCells(slot);
+        for(const Slice& fieldSlice : field.m_slices)
+        {
+            const size_t rows = fieldSlice.m_values.size() / fieldSlice.m_stride;
+            for(size_t row = 0; row < rows; ++row)
+                std::memcpy(cells + (fieldSlice.m_globalY + row) * header->m_width + fieldSlice.m_globalX,
+                            &fieldSlice.m_values[row * fieldSlice.m_stride],
+                            fieldSlice.m_stride * sizeof(values_t));
+        }
+
+        slot->m_sequence.store(2 * frame, std::memory_order_release);
+        header->m_latest.store(frame, std::memory_order_release);
+    }
+
+private:
+    LiveFeedHeader* header() const
+    {
+        return reinterpret_cast<LiveFeedHeader*>(m_data);
+    }
+
+    LiveFeedSlot* slot(const size_t index) const
+    {
+        const LiveFeedHeader* header = this->header();
+        return reinterpret_cast<LiveFeedSlot*>(m_data + liveFeedAligned(sizeof(LiveFeedHeader)) +
+                                               index * liveFeedSlotBytes(header->m_width, header->m_height));
+    }
+
+    static values_t* slotCells(LiveFeedSlot* slot)
+    {
+        return reinterpret_cast<values_t*>(reinterpret_cast<char*>(slot) + liveFeedAligned(sizeof(LiveFeedSlot)));
+    }
+
+    const size_t m_bytes;
+    int m_file;
+    char* m_data;
+};
+
+/*!
+ * \brief Чтение кадров из разделяемой памяти (наблюдатель)
+ */
+class LiveFeedReader
+{
+public:
+    LiveFeedReader():
+        m_file{-1},
+        m_data{nullptr},
+        m_bytes{0},
+        m_inode{0}
+    {}
+
+    LiveFeedReader(const LiveFeedReader&) = delete;
+    LiveFeedReader& operator=(const LiveFeedReader&) = delete;
+
+    ~LiveFeedReader()
+    {
+        detach();
+    }
+
+    /*!
+     * \brief Подключается к буферу, если он существует
+     * \return true если подключение удалось
+     */
+    bool attach()
+    {
+        detach();
+
+        m_file = shm_open(LIVE_FEED_NAME, O_RDONLY, 0);
+        if(m_file < 0)
+            return false;
+
+        struct stat info;
+        if(fstat(m_file, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(LiveFeedHeader))
+        {
+            detach();
+            return false;
+        }
+
+        m_bytes = info.st_size;
+        m_inode = info.st_ino;
+        void* data = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, m_file, 0);
+        if(data == MAP_FAILED)
+        {
+            m_data = nullptr;
+            detach();
+            return false;
+        }
+        m_data = static_cast<const char*>(data);
+
+        const LiveFeedHeader* header = this->header();
+        if(header->m_magic != LIVE_FEED_MAGIC || header->m_version != LIVE_FEED_VERSION || !header->m_slots ||
+           liveFeedBytes(header->m_width, header->m_height, header->m_slots) > m_bytes)
+        {
+            detach();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    void detach()
+    {
+        if(m_data)
+            munmap(const_cast<char*>(m_data), m_bytes);
+        if(m_file >= 0)
+            close(m_file);
+        m_data = nullptr;
+        m_file = -1;
+        m_bytes = 0;
+    }
+
+    bool attached() const
+    {
+        return m_data != nullptr;
+    }
+
+    /*!
+     * \brief Был ли буфер пересоздан (запущен новый расчет) после подключения
+     */
+    bool replaced() const
+    {
+        const int file = shm_open(LIVE_FEED_NAME, O_RDONLY, 0);
+        if(file < 0)
+            return false;
+
+        struct stat info;
+        const bool result = fstat(file, &info) == 0 && (!attached() || info.st_ino != m_inode);
+        close(file);
+        return result;
+    }
+
+    /*!
+     * \brief Отдает последний кадр, если он новее уже прочитанного.
+     * Кадр читается прямо из разделяемой памяти; если во время чтения его перезаписали,
+     * результат чтения надо отбросить (функция вернет false).
+     * \param lastFrame номер последнего прочитанного кадра (обновляется при успехе)
+     * \param consumer функция (клетки, ширина, высота, номер итерации), читающая кадр
+     * \return true если прочитан новый целый кадр
+     */
+    template<typename Consumer>
+    bool readLatest(uint64_t& lastFrame, Consumer consumer) const
+    {
+        if(!attached())
+            return false;
+
+        const LiveFeedHeader* header = this->header();
+        const uint64_t frame = header->m_latest.load(std::memory_order_acquire);
+        if(!frame || frame == lastFrame)
+            return false;
+
+        const LiveFeedSlot* slot = this->slot(frame % header->m_slots);
+        const uint64_t sequence = slot->m_sequence.load(std::memory_order_acquire);
+        if(sequence != 2 * frame)
+            return false;
+
+        consumer(reinterpret_cast<const values_t*>(reinterpret_cast<const char*>(slot) + liveFeedAligned(sizeof(LiveFeedSlot))),
+                 static_cast<size_t>(header->m_width), static_cast<size_t>(header->m_height), slot->m_iteration);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot->m_sequence.load(std::memory_order_relaxed) != sequence)
+            return false;
+
+        lastFrame = frame;
+        return true;
+    }
+
+private:
+    const LiveFeedHeader* header() const
+    {
+        return reinterpret_cast<const LiveFeedHeader*>(m_data);
+    }
+
+    const LiveFeedSlot* slot(const size_t index) const
+    {
+        const LiveFeedHeader* header = this->header();
+        return reinterpret_cast<const LiveFeedSlot*>(m_data + liveFeedAligned(sizeof(LiveFeedHeader)) +
+                                                     index * liveFeedSlotBytes(header->m_width, header->m_height));
+    }
+
+    int m_file;
+    const char* m_data;
+    size_t m_bytes;
+    ino_t m_inode;//!< Объект, к которому подключен читатель
+};
+
+#endif // LIVEFEED_H
@@ -1,11 +1,13 @@
 #include "lab2types.h"
 
 #include "utils.h"
-#include "extendedslice.h"
+#include "deepextendedslice.h"
 
 #include <memory>
 #include <vector>
 #include <fstream>
+#include <cstdint>
+#include <cmath>
 
 //Если определено, приложение вставляет задержки после каждой итерации
 //#define DELAYS
@@ -13,20 +15,88 @@
 //Если определено, производится периодическая запись поля в файл
 //#define FILE_SAVE
 
+//Если определено, после каждой итерации поле записывается в снимок field.snap,
+//который можно отобразить в память без разбора (см. snapshot.h)
+//#define SNAPSHOT_SAVE
+
 //Если определено, поле заполняется тестовым примером иначе - случайно
 //#define EXAMPLE
 
+//Если определено, после каждой итерации вместо сбора всего поля собирается
+//прореженная картина прямоугольника, запрошенного наблюдателем (см. monitor.h)
+//#define MONITORING
+
+//Если определено, после каждой итерации поле публикуется в кольцевой буфер в разделяемой памяти
+//для FieldViewer (см. livefeed.h)
+//#define LIVE_FEED
+
+//Если определено, куски поля хранятся в файлах на диске и обрабатываются потоково полосами строк
+//(поле может не помещаться в память, поле на главном процессе не собирается)
+//#define OUT_OF_CORE
+
+//Если определено, вместо одного большого поля считается набор маленьких независимых полей
+//с разными зернами и плотностями (по ENSEMBLE_UNIVERSES / количество процессов на процесс)
+//#define ENSEMBLE
+
 #ifdef DELAYS
 #   include <chrono>
 #   include <thread>
     const int64_t DELAY = 400;//!< Задержка между итерациями в мс
 #endif
 
+#ifdef MONITORING
+#   include "monitor.h"
+#   include <cstdio>
+    const uint64_t MONITOR_DEFAULT_FACTOR = 8u;//!< Прореживание по умолчанию (пока наблюдатель ничего не запросил)
+#endif
+
+#ifdef LIVE_FEED
+#   include "livefeed.h"
+#endif
+
+#ifdef SNAPSHOT_SAVE
+#   include "snapshot.h"
+    const char SNAPSHOT_FILE[] = "field.snap";
+#endif
+
+#ifdef OUT_OF_CORE
+#   if defined(MONITORING) || defined(FILE_SAVE) || defined(SNAPSHOT_SAVE) || defined(LIVE_FEED)
+#       error "OUT_OF_CORE mode does not gather the field, MONITORING, FILE_SAVE, SNAPSHOT_SAVE and LIVE_FEED are not supported"
+#   endif
+#   include "outofcoreslice.h"
+#   include <string>
+    const char OUT_OF_CORE_FILE_PREFIX[] = "life_slice_";//!< Префикс файлов кусков (добавляется номер процесса)
+    const size_t OUT_OF_CORE_BAND_ROWS = 256u;//!< Количество строк в полосе подгрузки с диска
+#endif
+
+#ifdef ENSEMBLE
+#   if defined(MONITORING) || defined(FILE_SAVE) || defined(SNAPSHOT_SAVE) || defined(LIVE_FEED) || defined(OUT_OF_CORE)
+#       error "ENSEMBLE mode does not support MONITORING, FILE_SAVE, SNAPSHOT_SAVE, LIVE_FEED and OUT_OF_CORE"
+#   endif
+#   include "ensemble.h"
+    const size_t ENSEMBLE_UNIVERSES = 4096u;//!< Общее количество полей
+    const size_t ENSEMBLE_X_SIZE = 64u;//!< Ширина каждого поля
+    const size_t ENSEMBLE_Y_SIZE = 64u;//!< Высота каждого поля
+    const uint64_t ENSEMBLE_SEED = 1u;//!< Зерно первого поля (у поля с номером i - ENSEMBLE_SEED + i)
+    const double ENSEMBLE_MIN_DENSITY = 0.05;//!< Плотность первого поля
+    const double ENSEMBLE_MAX_DENSITY = 0.5;//!< Плотность последнего поля
+    const char ENSEMBLE_RESULT_FILE[] = "ensemble.csv";//!< Файл со статистикой по полям
+#endif
+
 const int PERIODIC_FIELD = 1;//!< Периодическое поле (1 - да / 0 - нет)
 const size_t FIELD_X_SIZE = 4200u;//!< Размер поля по ширине
 const size_t FIELD_Y_SIZE = 4200u;//!< Размер поля по высоте
 const size_t STEPS_PER_ITERATION = 10u;//!<  Количество шагов игры между сбросами состояния поля на диск
 const size_t ITERATIONS = 10u;//!< Количество итераций (одна итерация = STEPS_PER_ITERATION шагов)
+const size_t HALO_DEPTH = 5u;//!< Глубина границ куска = количество шагов игры между обменами границами
+const size_t TEMPORAL_TILE_BYTES = 256u * 1024u;//!< Объем полосы куска, проходящей HALO_DEPTH шагов подряд (~ L2 кэш)
+const size_t MAX_CYCLE_PERIOD = 8u;//!< Максимальный период цикла (в обменах границами), который отслеживается для досрочной остановки (0 - не отслеживать)
+
+const size_t REBALANCE_PERIOD = 1u;//!< Через сколько итераций проверяется баланс нагрузки (0 - не перераспределять куски)
+const double IMBALANCE_THRESHOLD = 1.25;//!< Отношение максимального времени шагов процесса к среднему, при котором поле перераспределяется
+const double IDLE_CELL_COST = 0.05;//!< Минимальная стоимость клетки относительно средней (пустые области тоже копируются)
+
+static_assert(STEPS_PER_ITERATION % HALO_DEPTH == 0, "STEPS_PER_ITERATION must be a multiple of HALO_DEPTH");
 
 //Тэги сообщений
 const int SENT_UP_BOUND_TAG = 1;
@@ -114,16 +184,512 @@ void createNetCommunicator(MPI_Comm* const comm, const int processesCount)
 }
 
 /*!
- * \brief Проводит несколько шагов игры на куске поля
- * \param extendedSlice кусок поля
+ * \brief Прямоугольное разбиение поля линиями разреза.
+ * Процесс с декартовыми координатами (x, y) владеет прямоугольником
+ * [m_xCuts[x], m_xCuts[x + 1]) x [m_yCuts[y], m_yCuts[y + 1]).
+ * Куски нумеруются так же, как процессы декартова коммуникатора: index = x * dimY + y.
+ */
+struct FieldPartition
+{
+    /*!
+     * \brief Конструктор равномерного разбиения
+     * \param processesCount Количество процессов
+     */
+    explicit FieldPartition(const int processesCount)
+    {
+        const ProcessesDims processesDims = getProcessesDims(processesCount);
+        const FieldStrides fieldStrides = getFieldStrides(processesCount);
+
+        for(int x = 0; x <= processesDims.first; ++x)
+            m_xCuts.push_back(x * fieldStrides.first);
+        for(int y = 0; y <= processesDims.second; ++y)
+            m_yCuts.push_back(y * fieldStrides.second);
+    }
+
+    size_t dimX() const
+    {
+        return m_xCuts.size() - 1;
+    }
+
+    size_t dimY() const
+    {
+        return m_yCuts.size() - 1;
+    }
+
+    /*!
+     * \brief Границы куска с заданным номером
+     * \param index номер куска (процесса в декартовом коммуникаторе)
+     * \param globalX, globalY координаты левого верхнего угла куска
+     * \param width, height размеры куска
+     */
+    void sliceBounds(const size_t index, size_t& globalX, size_t& globalY, size_t& width, size_t& height) const
+    {
+        const size_t x = index / dimY();
+        const size_t y = index % dimY();
+        globalX = m_xCuts[x];
+        globalY = m_yCuts[y];
+        width = m_xCuts[x + 1] - m_xCuts[x];
+        height = m_yCuts[y + 1] - m_yCuts[y];
+    }
+
+    /*!
+     * \brief Создает пустой кусок поля с заданным номером
+     * \param index номер куска (процесса в декартовом коммуникаторе)
+     */
+    Slice makeZeroSlice(const size_t index) const
+    {
+        size_t globalX, globalY, width, height;
+        sliceBounds(index, globalX, globalY, width, height);
+        return Slice::makeZeroSlice(globalX, globalY, width, height);
+    }
+
+    /*!
+     * \brief Пересчитывает линии разреза по измеренной стоимости кусков, если нагрузка разбалансирована
+     * \param costs время шагов каждого процесса (по номерам кусков)
+     * \return true если разбиение изменилось
+     */
+    bool rebalance(const std::vector<double>& costs)
+    {
+        double total = 0;
+        double maxCost = 0;
+        for(const double cost : costs)
+        {
+            total += cost;
+            maxCost = std::max(maxCost, cost);
+        }
+
+        if(total <= 0 || maxCost < IMBALANCE_THRESHOLD * total / costs.size())
+            return false;
+
+        std::vector<double> columnCosts(dimX(), 0.);
+        std::vector<double> rowCosts(dimY(), 0.);
+        for(size_t index = 0; index < costs.size(); ++index)
+        {
+            columnCosts[index / dimY()] += costs[index];
+            rowCosts[index % dimY()] += costs[index];
+        }
+
+        const std::vector<size_t> xCuts = balancedCuts(m_xCuts, columnCosts);
+        const std::vector<size_t> yCuts = balancedCuts(m_yCuts, rowCosts);
+        if(xCuts == m_xCuts && yCuts == m_yCuts)
+            return false;
+
+        m_xCuts = xCuts;
+        m_yCuts = yCuts;
+        return true;
+    }
+
+    std::vector<size_t> m_xCuts;//!< Линии разреза по горизонтали (dimX + 1 значение)
+    std::vector<size_t> m_yCuts;//!< Линии разреза по вертикали (dimY + 1 значение)
+
+private:
+    /*!
+     * \brief Линии разреза, делящие стоимость поровну.
+     * Стоимость внутри полосы считается равномерно распределенной по ее ширине.
+     * \param cuts текущие линии разреза
+     * \param costs стоимость каждой полосы
+     * \return новые линии разреза (ширина полос не меньше HALO_DEPTH)
+     */
+    static std::vector<size_t> balancedCuts(const std::vector<size_t>& cuts, const std::vector<double>& costs)
+    {
+        const size_t strips = costs.size();
+        const size_t length = cuts.back();
+
+        double total = 0;
+        for(const double cost : costs)
+            total += cost;
+
+        std::vector<double> densities(strips);
+        double weightedTotal = 0;
+        for(size_t strip = 0; strip < strips; ++strip)
+        {
+            const double width = static_cast<double>(cuts[strip + 1] - cuts[strip]);
+            densities[strip] = std::max(costs[strip] / width, IDLE_CELL_COST * total / length);
+            weightedTotal += densities[strip] * width;
+        }
+
+        std::vector<size_t> result(1, 0);
+        double accumulated = 0;
+        size_t strip = 0;
+        for(size_t cut = 1; cut < strips; ++cut)
+        {
+            const double target = weightedTotal * cut / strips;
+            while(accumulated + densities[strip] * (cuts[strip + 1] - cuts[strip]) < target)
+            {
+                accumulated += densities[strip] * (cuts[strip + 1] - cuts[strip]);
+                ++strip;
+            }
+            const double position = cuts[strip] + (target - accumulated) / densities[strip];
+            result.push_back(static_cast<size_t>(position + 0.5));
+        }
+        result.push_back(length);
+
+        for(size_t cut = 1; cut < strips; ++cut)
+            result[cut] = std::max(result[cut], result[cut - 1] + HALO_DEPTH);
+        for(size_t cut = strips - 1; cut > 0; --cut)
+            result[cut] = std::min(result[cut], result[cut + 1] - HALO_DEPTH);
+
+        return result;
+    }
+}; // end of FieldPartition
+
+/*!
+ * \brief Проверяет баланс нагрузки между процессами и при необходимости пересчитывает разбиение.
+ * Вызывается всеми процессами одновременно, решение у всех процессов одинаковое.
+ * \param partition разбиение поля
+ * \param computeTime время шагов игры текущего процесса с момента прошлой проверки
  * \param netComm коммуникатор декартовой топологии
+ * \return true если разбиение изменилось и куски нужно перераспределить
  */
-void doLifeSteps(ExtendedSlice& extendedSlice, const MPI_Comm netComm)
+bool checkLoadBalance(FieldPartition& partition, const double computeTime, const MPI_Comm netComm)
+{
+    int size;
+    MPI_Comm_size(netComm, &size);
+
+    std::vector<double> times(size, 0.);
+    MPI_Allgather(&computeTime, 1, MPI_DOUBLE, times.data(), 1, MPI_DOUBLE, netComm);
+
+    return partition.rebalance(times);
+}
+
+/*!
+ * \brief Пересечение куска одного разбиения с куском другого
+ * \param first, firstIndex разбиение и номер первого куска
+ * \param second, secondIndex разбиение и номер второго куска
+ * \param globalX, globalY координаты левого верхнего угла пересечения
+ * \param width, height размеры пересечения
+ * \return количество клеток в пересечении (0, если куски не пересекаются)
+ */
+size_t sliceOverlap(const FieldPartition& first, const size_t firstIndex,
+                    const FieldPartition& second, const size_t secondIndex,
+                    size_t& globalX, size_t& globalY, size_t& width, size_t& height)
+{
+    size_t firstX, firstY, firstWidth, firstHeight;
+    size_t secondX, secondY, secondWidth, secondHeight;
+    first.sliceBounds(firstIndex, firstX, firstY, firstWidth, firstHeight);
+    second.sliceBounds(secondIndex, secondX, secondY, secondWidth, secondHeight);
+
+    globalX = std::max(firstX, secondX);
+    globalY = std::max(firstY, secondY);
+    const size_t right = std::min(firstX + firstWidth, secondX + secondWidth);
+    const size_t bottom = std::min(firstY + firstHeight, secondY + secondHeight);
+    width = right > globalX ? right - globalX : 0;
+    height = bottom > globalY ? bottom - globalY : 0;
+    return width * height;
+}
+
+/*!
+ * \brief Перераспределяет куски поля по новому разбиению без участия главного процесса.
+ * Каждый процесс отправляет каждому другому только пересечение своего старого куска с его новым
+ * (прямоугольники, сменившие владельца), размеры передач известны всем из линий разреза.
+ * Вызывается всеми процессами одновременно.
+ * \param slice свой кусок по старому разбиению
+ * \param oldPartition старое разбиение
+ * \param newPartition новое разбиение
+ * \param netComm коммуникатор декартовой топологии
+ * \return свой кусок по новому разбиению
+ */
+Slice redistributeSlice(const Slice& slice, const FieldPartition& oldPartition,
+                        const FieldPartition& newPartition, const MPI_Comm netComm)
+{
+    int size, rank;
+    MPI_Comm_size(netComm, &size);
+    MPI_Comm_rank(netComm, &rank);
+
+    Slice result = newPartition.makeZeroSlice(rank);
+
+    std::vector<int> sendCounts(size), sendOffsets(size), receiveCounts(size), receiveOffsets(size);
+    std::vector<values_t> sendBuffer;
+    size_t receiveTotal = 0;
+    size_t globalX, globalY, width, height;
+    for(int process = 0; process < size; ++process)
+    {
+        sendOffsets[process] = sendBuffer.size();
+        sendCounts[process] = sliceOverlap(oldPartition, rank, newPartition, process, globalX, globalY, width, height);
+        for(size_t row = globalY; row < globalY + height; ++row)
+        {
+            const auto rowBegin = slice.m_values.begin() + (row - slice.m_globalY) * slice.m_stride
+                                  + (globalX - slice.m_globalX);
+            sendBuffer.insert(sendBuffer.end(), rowBegin, rowBegin + width);
+        }
+
+        receiveOffsets[process] = receiveTotal;
+        receiveCounts[process] = sliceOverlap(oldPartition, process, newPartition, rank, globalX, globalY, width, height);
+        receiveTotal += receiveCounts[process];
+    }
+
+    std::vector<values_t> receiveBuffer(receiveTotal);
+    MPI_Alltoallv(sendBuffer.data(), sendCounts.data(), sendOffsets.data(), MPI_VALUES_TYPE,
+                  receiveBuffer.data(), receiveCounts.data(), receiveOffsets.data(), MPI_VALUES_TYPE, netComm);
+
+    for(int process = 0; process < size; ++process)
+    {
+        sliceOverlap(oldPartition, process, newPartition, rank, globalX, globalY, width, height);
+        auto rowBegin = receiveBuffer.begin() + receiveOffsets[process];
+        for(size_t row = globalY; row < globalY + height; ++row, rowBegin += width)
+            std::copy(rowBegin, rowBegin + width, result.m_values.begin() + (row - result.m_globalY) * result.m_stride
+                                                  + (globalX - result.m_globalX));
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Нужно ли собирать все поле на главном процессе после итерации
+ * \param generationsLeft оставшееся количество поколений
+ */
+bool fieldGatherNeeded(const size_t generationsLeft)
+{
+#if defined(MONITORING) && !defined(FILE_SAVE) && !defined(SNAPSHOT_SAVE) && !defined(LIVE_FEED)
+    return !generationsLeft;
+#else
+    (void)generationsLeft;
+    return true;
+#endif
+}
+
+#ifdef MONITORING
+/*!
+ * \brief Канал наблюдения за полем.
+ * Главный процесс читает запрос наблюдателя, процессы, чьи куски пересекают запрошенный
+ * прямоугольник, считают население блоков и суммируют его на главном процессе.
+ * Объем передачи определяется размером кадра, а не поля.
+ */
+class MonitorChannel
+{
+public:
+    MonitorChannel():
+        m_comm(MPI_COMM_NULL),
+        m_request{0, 0, FIELD_X_SIZE, FIELD_Y_SIZE, MONITOR_DEFAULT_FACTOR},
+        m_splitDone(false)
+    {}
+
+    MonitorChannel(const MonitorChannel&) = delete;
+    MonitorChannel& operator=(const MonitorChannel&) = delete;
+
+    ~MonitorChannel()
+    {
+        if(m_comm != MPI_COMM_NULL)
+            MPI_Comm_free(&m_comm);
+    }
+
+    /*!
+     * \brief Снимает кадр наблюдения. Вызывается всеми процессами одновременно.
+     * \param slice кусок поля текущего процесса
+     * \param netComm коммуникатор декартовой топологии
+     * \param mainProcessNetRank номер главного процесса в netComm
+     * \param partitionChanged разбиение поля изменилось с прошлого кадра
+     * \param iteration номер итерации
+     */
+    void publish(const Slice& slice, const MPI_Comm netComm, const int mainProcessNetRank,
+                 const bool partitionChanged, const size_t iteration)
+    {
+        int netRank;
+        MPI_Comm_rank(netComm, &netRank);
+        const bool isMain = netRank == mainProcessNetRank;
+
+        MonitorRequest request = m_request;
+        if(isMain && readMonitorRequest(request))
+            clamp(request);
+
+        uint64_t packedRequest[5] = {request.m_x, request.m_y, request.m_width, request.m_height, request.m_factor};
+        MPI_Bcast(packedRequest, 5, MPI_UINT64_T, mainProcessNetRank, netComm);
+        request = MonitorRequest{packedRequest[0], packedRequest[1], packedRequest[2], packedRequest[3], packedRequest[4]};
+
+        if(!m_splitDone || partitionChanged || !(request == m_request))
+        {
+            m_request = request;
+            if(m_comm != MPI_COMM_NULL)
+                MPI_Comm_free(&m_comm);
+
+            const bool participates = isMain || overlaps(slice);
+            MPI_Comm_split(netComm, participates ? 0 : MPI_UNDEFINED, isMain ? 0 : netRank + 1, &m_comm);
+            m_splitDone = true;
+        }
+
+        if(m_comm == MPI_COMM_NULL)
+            return;
+
+        MonitorFrame frame;
+        frame.m_request = m_request;
+        frame.m_iteration = iteration;
+        frame.m_population.resize(m_request.columns() * m_request.rows(), 0);
+        accumulate(slice, frame.m_population);
+
+        if(isMain)
+        {
+            MPI_Reduce(MPI_IN_PLACE, frame.m_population.data(), frame.m_population.size(),
+                       MPI_UINT32_T, MPI_SUM, 0, m_comm);
+
+            const std::string tmpName = std::string(MONITOR_FRAME_FILE) + ".tmp";
+            {
+                std::ofstream os(tmpName, std::ios::binary);
+                boost::archive::binary_oarchive oar(os);
+                oar << frame;
+            }
+            std::rename(tmpName.c_str(), MONITOR_FRAME_FILE);
+        }
+        else
+        {
+            MPI_Reduce(frame.m_population.data(), nullptr, frame.m_population.size(),
+                       MPI_UINT32_T, MPI_SUM, 0, m_comm);
+        }
+    }
+
+private:
+    /*!
+     * \brief Ограничивает запрос размерами поля
+     */
+    static void clamp(MonitorRequest& request)
+    {
+        request.m_x = std::min<uint64_t>(request.m_x, FIELD_X_SIZE - 1);
+        request.m_y = std::min<uint64_t>(request.m_y, FIELD_Y_SIZE - 1);
+        request.m_width = std::min<uint64_t>(request.m_width, FIELD_X_SIZE - request.m_x);
+        request.m_height = std::min<uint64_t>(request.m_height, FIELD_Y_SIZE - request.m_y);
+    }
+
+    bool overlaps(const Slice& slice) const
+    {
+        const size_t sliceHeight = slice.m_values.size() / slice.m_stride;
+        return slice.m_globalX < m_request.m_x + m_request.m_width &&
+               m_request.m_x < slice.m_globalX + slice.m_stride &&
+               slice.m_globalY < m_request.m_y + m_request.m_height &&
+               m_request.m_y < slice.m_globalY + sliceHeight;
+    }
+
+    /*!
+     * \brief Добавляет живые клетки куска в блоки кадра
+     */
+    void accumulate(const Slice& slice, std::vector<uint32_t>& population) const
+    {
+        if(!overlaps(slice))
+            return;
+
+        const size_t sliceHeight = slice.m_values.size() / slice.m_stride;
+        const size_t firstX = std::max<size_t>(slice.m_globalX, m_request.m_x);
+        const size_t lastX = std::min<size_t>(slice.m_globalX + slice.m_stride, m_request.m_x + m_request.m_width);
+        const size_t firstY = std::max<size_t>(slice.m_globalY, m_request.m_y);
+        const size_t lastY = std::min<size_t>(slice.m_globalY + sliceHeight, m_request.m_y + m_request.m_height);
+
+        for(size_t y = firstY; y < lastY; ++y)
+        {
+            const values_t* row = slice.m_values.data() + (y - slice.m_globalY) * slice.m_stride;
+            uint32_t* blocks = &population[((y - m_request.m_y) / m_request.m_factor) * m_request.columns()];
+            for(size_t x = firstX; x < lastX; ++x)
+                blocks[(x - m_request.m_x) / m_request.m_factor] += row[x - slice.m_globalX] ? 1 : 0;
+        }
+    }
+
+    MPI_Comm m_comm;//!< Коммуникатор процессов, участвующих в кадре (главный процесс - 0)
+    MonitorRequest m_request;//!< Текущий запрос
+    bool m_splitDone;
+}; // end of MonitorChannel
+#endif
+
+/*!
+ * \brief Детектор установившегося состояния поля (неподвижной точки или цикла).
+ * Хранит кольцо хэшей всего поля за последние MAX_CYCLE_PERIOD обменов границами
+ * (поколения регистрируются через каждые m_depth шагов, m_depth - глубина границ куска).
+ */
+class CycleDetector
+{
+public:
+    CycleDetector():
+        m_history(MAX_CYCLE_PERIOD, 0),
+        m_generation(0),
+        m_period(0),
+        m_detectionGeneration(0)
+    {}
+
+    /*!
+     * \brief Регистрирует хэш очередного поколения
+     * \param hash Хэш всего поля
+     * \return Найденный период цикла (0 - цикл не найден)
+     */
+    size_t push(const uint64_t hash)
+    {
+        if(m_period || m_history.empty())
+            return m_period;
+
+        const size_t known = std::min(m_generation, m_history.size());
+        for(size_t period = 1; period <= known; ++period)
+        {
+            if(m_history[(m_generation - period) % m_history.size()] == hash)
+            {
+                m_period = period;
+                m_detectionGeneration = m_generation;
+                return m_period;
+            }
+        }
+
+        m_history[m_generation % m_history.size()] = hash;
+        ++m_generation;
+        return 0;
+    }
+
+    bool enabled() const
+    {
+        return !m_history.empty() && !m_period;
+    }
+
+    size_t generation() const
+    {
+        return m_generation;
+    }
+
+    size_t period() const
+    {
+        return m_period;
+    }
+
+    size_t detectionGeneration() const
+    {
+        return m_detectionGeneration;
+    }
+
+private:
+    std::vector<uint64_t> m_history;//!< Кольцо хэшей последних поколений
+    size_t m_generation;//!< Количество зарегистрированных поколений
+    size_t m_period;//!< Найденный период (0 - не найден)
+    size_t m_detectionGeneration;//!< Поколение, на котором обнаружен цикл
+}; // end of CycleDetector
+
+/*!
+ * \brief Считает хэш всего поля и регистрирует его в детекторе.
+ * Вызывается всеми процессами коммуникатора одновременно.
+ * \param sliceHash хэш куска поля текущего процесса
+ * \param netComm коммуникатор декартовой топологии
+ * \param cycleDetector детектор цикла
+ * \return Найденный период цикла (0 - цикл не найден)
+ */
+size_t registerGeneration(const uint64_t sliceHash, const MPI_Comm netComm, CycleDetector& cycleDetector)
+{
+    //Хэш куска зависит только от клеток (см. cellsHash), поэтому хэш поля не меняется при перераспределении
+    uint64_t hash = sliceHash;
+    MPI_Allreduce(MPI_IN_PLACE, &hash, 1, MPI_UINT64_T, MPI_SUM, netComm);
+
+    return cycleDetector.push(hash);
+}
+
+/*!
+ * \brief Проводит несколько шагов игры на куске поля.
+ * Границы глубиной m_depth куска передаются один раз на m_depth шагов.
+ * Если поле вошло в цикл, оставшееся число поколений сокращается до остатка от деления на период,
+ * так что итоговое состояние совпадает с состоянием при полном прогоне.
+ * \param extendedSlice кусок поля с границами (DeepExtendedSlice или OutOfCoreSlice)
+ * \param netComm коммуникатор декартовой топологии
+ * \param cycleDetector детектор цикла (общий для всех вызовов)
+ * \param generationsLeft оставшееся количество поколений
+ * \param computeTime накапливаемое время вычисления шагов (без обменов)
+ */
+template<typename ExtendedSliceType>
+void doLifeSteps(ExtendedSliceType& extendedSlice, const MPI_Comm netComm,
+                 CycleDetector& cycleDetector, size_t& generationsLeft, double& computeTime)
 {
     static bool firstRun = true;
     static int upperRank, lowerRank, leftRank, rightRank;
 
-    const int bufSize = FIELD_X_SIZE + FIELD_Y_SIZE + MPI_BSEND_OVERHEAD;
+    const int bufSize = 2 * HALO_DEPTH * (FIELD_X_SIZE + FIELD_Y_SIZE + 2 * HALO_DEPTH) + 4 * MPI_BSEND_OVERHEAD;
     static values_t buf[bufSize];
 
     if(firstRun)
@@ -134,18 +700,21 @@ void doLifeSteps(ExtendedSlice& extendedSlice, const MPI_Comm netComm)
         firstRun = false;
     }
 
-    int rank;
-    MPI_Comm_rank(netComm, &rank);
+    extendedSlice.setDeadBounds(upperRank == MPI_PROC_NULL, lowerRank == MPI_PROC_NULL,
+                                leftRank == MPI_PROC_NULL, rightRank == MPI_PROC_NULL);
 
-    size_t steps = STEPS_PER_ITERATION;
+    if(cycleDetector.enabled() && cycleDetector.generation() == 0)
+        registerGeneration(extendedSlice.hash(), netComm, cycleDetector);
+
+    size_t steps = std::min(STEPS_PER_ITERATION, generationsLeft);
     while(steps)
     {
         MPI_Status status;
 
         if(upperRank != MPI_PROC_NULL)
         {
-            std::vector<values_t> firstRow = extendedSlice.getUpperRow();
-            MPI_Bsend(firstRow.data(), firstRow.size(),
+            std::vector<values_t> firstRows = extendedSlice.getUpperRows();
+            MPI_Bsend(firstRows.data(), firstRows.size(),
                       MPI_VALUES_TYPE, upperRank, SENT_UP_BOUND_TAG, netComm);
         }
 
@@ -154,8 +723,8 @@ void doLifeSteps(ExtendedSlice& extendedSlice, const MPI_Comm netComm)
             MPI_Recv(extendedSlice.m_lowerBound.data(), extendedSlice.m_lowerBound.size(),
                      MPI_VALUES_TYPE, lowerRank, SENT_UP_BOUND_TAG, netComm, &status);
 
-            std::vector<values_t> lastRow = extendedSlice.getLowerRow();
-            MPI_Bsend(lastRow.data(), lastRow.size(),
+            std::vector<values_t> lastRows = extendedSlice.getLowerRows();
+            MPI_Bsend(lastRows.data(), lastRows.size(),
                       MPI_VALUES_TYPE, lowerRank, SENT_DOWN_BOUND_TAG, netComm);
         }
 
@@ -167,8 +736,8 @@ void doLifeSteps(ExtendedSlice& extendedSlice, const MPI_Comm netComm)
 
         if(leftRank != MPI_PROC_NULL)
         {
-            std::vector<values_t> firstColumn = extendedSlice.getFirstExtendedColumn();
-            MPI_Bsend(firstColumn.data(), firstColumn.size(),
+            std::vector<values_t> firstColumns = extendedSlice.getFirstExtendedColumns();
+            MPI_Bsend(firstColumns.data(), firstColumns.size(),
                       MPI_VALUES_TYPE, leftRank, SENT_LEFT_BOUND_TAG, netComm);
         }
 
@@ -177,8 +746,8 @@ void doLifeSteps(ExtendedSlice& extendedSlice, const MPI_Comm netComm)
             MPI_Recv(extendedSlice.m_rightExtendedBound.data(), extendedSlice.m_rightExtendedBound.size(),
                      MPI_VALUES_TYPE, rightRank, SENT_LEFT_BOUND_TAG, netComm, &status);
 
-            std::vector<values_t> lastColumn = extendedSlice.getLastExtendedColumn();
-            MPI_Bsend(lastColumn.data(), lastColumn.size(),
+            std::vector<values_t> lastColumns = extendedSlice.getLastExtendedColumns();
+            MPI_Bsend(lastColumns.data(), lastColumns.size(),
                       MPI_VALUES_TYPE, rightRank, SENT_RIGHT_BOUND_TAG, netComm);
         }
 
@@ -188,12 +757,166 @@ void doLifeSteps(ExtendedSlice& extendedSlice, const MPI_Comm netComm)
                      MPI_VALUES_TYPE, leftRank, SENT_RIGHT_BOUND_TAG, netComm, &status);
         }
 
-        extendedSlice.lifeStep();
+        const size_t blockSteps = std::min(steps, extendedSlice.m_depth);
+        const double stepsStart = MPI_Wtime();
+        extendedSlice.lifeSteps(blockSteps);
+        computeTime += MPI_Wtime() - stepsStart;
+
+        steps -= blockSteps;
+        generationsLeft -= blockSteps;
+
+        if(cycleDetector.enabled())
+        {
+            const size_t period = registerGeneration(extendedSlice.hash(), netComm, cycleDetector);
+            if(period)
+            {
+                generationsLeft %= period * extendedSlice.m_depth;
+                steps = std::min(steps, generationsLeft);
+            }
+        }
+    }
+}
+
+#ifdef OUT_OF_CORE
+/*!
+ * \brief Игра с хранением кусков поля на диске, общая для всех процессов.
+ * Каждый процесс сам заполняет свой кусок, перераспределение нагрузки не выполняется.
+ * Главный процесс выводит итоговое население поля.
+ * \param netComm коммуникатор декартовой топологии
+ * \param processesCount количество процессов
+ */
+void doOutOfCoreLife(const MPI_Comm netComm, const int processesCount)
+{
+    int netRank;
+    MPI_Comm_rank(netComm, &netRank);
+
+    const FieldPartition partition(processesCount);
+    size_t globalX, globalY, width, height;
+    partition.sliceBounds(netRank, globalX, globalY, width, height);
+
+    OutOfCoreSlice slice(OUT_OF_CORE_FILE_PREFIX + std::to_string(netRank), globalX, globalY, width, height,
+                         OUT_OF_CORE_BAND_ROWS);
+
+#ifndef EXAMPLE
+    srand(time(0) + netRank);
+    slice.fill([width](const size_t, values_t* row)
+    {
+        for(size_t x = 0; x < width; ++x)
+            row[x] = (rand() % 10 > 7) ? 1 : 0;
+    });
+#else
+    slice.fill([width, globalX, globalY](const size_t y, values_t* row)
+    {
+        std::fill(row, row + width, 0);
+        if(globalX == 0 && globalY == 0)
+        {
+            //Запустим, к примеру, планер
+            if(y == 0)
+                row[1] = 1;
+            if(y == 1)
+                row[2] = 1;
+            if(y == 2)
+                row[0] = row[1] = row[2] = 1;
+        }
+    });
+#endif
+
+    MPI_Barrier(netComm);
 
-        --steps;
+    CycleDetector cycleDetector;
+    size_t generationsLeft = ITERATIONS * STEPS_PER_ITERATION;
+    double computeTime = 0;
+    while(generationsLeft)
+    {
+        doLifeSteps(slice, netComm, cycleDetector, generationsLeft, computeTime);
+        MPI_Barrier(netComm);
     }
+
+    unsigned long long population = slice.population();
+    MPI_Reduce(netRank ? &population : MPI_IN_PLACE, &population, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, netComm);
+
+    if(netRank == 0)
+    {
+        printf("Population: %llu\n", population);
+        if(cycleDetector.period())
+            printf("Field reached a cycle with period %zu at generation %zu\n",
+                   cycleDetector.period(), cycleDetector.detectionGeneration());
+    }
+}
+#endif
+
+#ifdef ENSEMBLE
+/*!
+ * \brief Плотность заполнения поля набора
+ * \param universe номер поля
+ */
+double ensembleDensity(const size_t universe)
+{
+    if(ENSEMBLE_UNIVERSES < 2)
+        return ENSEMBLE_MIN_DENSITY;
+    return ENSEMBLE_MIN_DENSITY + (ENSEMBLE_MAX_DENSITY - ENSEMBLE_MIN_DENSITY) * universe / (ENSEMBLE_UNIVERSES - 1);
 }
 
+/*!
+ * \brief Игра на наборе независимых полей, общая для всех процессов.
+ * Процессы не обмениваются данными до конца игры, статистика собирается одной редукцией.
+ * Главный процесс записывает статистику в ENSEMBLE_RESULT_FILE.
+ * \param rank номер процесса
+ * \param processesCount количество процессов
+ */
+void doEnsembleLife(const int rank, const int processesCount)
+{
+    const size_t firstUniverse = ENSEMBLE_UNIVERSES * rank / processesCount;
+    const size_t lastUniverse = ENSEMBLE_UNIVERSES * (rank + 1) / processesCount;
+
+    LifeEnsemble ensemble(ENSEMBLE_X_SIZE, ENSEMBLE_Y_SIZE, lastUniverse - firstUniverse);
+    for(size_t universe = firstUniverse; universe < lastUniverse; ++universe)
+        ensemble.randomize(universe - firstUniverse, ENSEMBLE_SEED + universe, ensembleDensity(universe));
+
+    //Начальное население, конечное население и последнее поколение с изменениями для всех полей
+    std::vector<uint32_t> statistics(3 * ENSEMBLE_UNIVERSES, 0);
+    const std::vector<uint32_t> initialPopulations = ensemble.populations();
+    std::copy(initialPopulations.begin(), initialPopulations.end(), statistics.begin() + firstUniverse);
+
+    //Если не изменилось ни одно поле, все поля процесса неподвижны - дальше считать нечего
+    const uint32_t generations = ITERATIONS * STEPS_PER_ITERATION;
+    for(uint32_t generation = 1; generation <= generations && ensemble.step(generation); ++generation)
+        ;
+
+    const std::vector<uint32_t> finalPopulations = ensemble.populations();
+    std::copy(finalPopulations.begin(), finalPopulations.end(),
+              statistics.begin() + ENSEMBLE_UNIVERSES + firstUniverse);
+    std::copy(ensemble.lastChanges().begin(), ensemble.lastChanges().end(),
+              statistics.begin() + 2 * ENSEMBLE_UNIVERSES + firstUniverse);
+
+    MPI_Reduce(rank ? statistics.data() : MPI_IN_PLACE, statistics.data(), statistics.size(),
+               MPI_UINT32_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if(rank != 0)
+        return;
+
+    std::ofstream os(ENSEMBLE_RESULT_FILE);
+    os << "universe;seed;density;initial population;final population;last change" << std::endl;
+
+    size_t stableUniverses = 0;
+    double meanPopulation = 0;
+    for(size_t universe = 0; universe < ENSEMBLE_UNIVERSES; ++universe)
+    {
+        const uint32_t lastChange = statistics[2 * ENSEMBLE_UNIVERSES + universe];
+        os << universe << ';' << ENSEMBLE_SEED + universe << ';' << ensembleDensity(universe) << ';'
+           << statistics[universe] << ';' << statistics[ENSEMBLE_UNIVERSES + universe] << ';'
+           << lastChange << std::endl;
+
+        if(lastChange < generations)
+            ++stableUniverses;
+        meanPopulation += statistics[ENSEMBLE_UNIVERSES + universe];
+    }
+
+    printf("Universes: %zu, still after %u generations: %zu, mean final population: %.2f\n",
+           ENSEMBLE_UNIVERSES, generations, stableUniverses, meanPopulation / ENSEMBLE_UNIVERSES);
+}
+#endif
+
 /*!
  * \brief Рабочий процесс (rank > 0).
  */
@@ -216,15 +939,20 @@ public:
     {
         double calculationTime = MPI_Wtime();
 
+#if defined(ENSEMBLE)
+        doEnsembleLife(m_rank, m_processesCount);
+#else
         MPI_Comm netComm;
         createNetCommunicator(&netComm, m_processesCount);
 
-        const FieldStrides fieldStrides = getFieldStrides(m_processesCount);
-        const size_t strideX = fieldStrides.first;
-        const size_t strideY = fieldStrides.second;
+#   ifdef OUT_OF_CORE
+        doOutOfCoreLife(netComm, m_processesCount);
+#   else
+        int netRank;
+        MPI_Comm_rank(netComm, &netRank);
 
-        Slice slice(0, 0, strideX);
-        slice.m_values.resize(strideX * strideY, 0);
+        FieldPartition partition(m_processesCount);
+        Slice slice = partition.makeZeroSlice(netRank);
 
         MPI_Status status;
 
@@ -235,21 +963,47 @@ public:
 
         const int mainProcessNetRank = status.MPI_SOURCE;
 
-        ExtendedSlice extendedSlice(slice);
+        std::unique_ptr<DeepExtendedSlice> extendedSlice(new DeepExtendedSlice(slice, HALO_DEPTH, TEMPORAL_TILE_BYTES));
 
-        size_t iterations = ITERATIONS;
+        CycleDetector cycleDetector;
+        size_t generationsLeft = ITERATIONS * STEPS_PER_ITERATION;
+        size_t iteration = 0;
+        double computeTime = 0;
+#ifdef MONITORING
+        MonitorChannel monitorChannel;
+#endif
 
-        while(iterations)
+        while(generationsLeft)
         {
-            doLifeSteps(extendedSlice, netComm);
+            doLifeSteps(*extendedSlice, netComm, cycleDetector, generationsLeft, computeTime);
 
-            MPI_Send(slice.m_values.data(), slice.m_values.size(),
-                     MPI_VALUES_TYPE, mainProcessNetRank, SENT_SLICE_TAG, netComm);
+            ++iteration;
+            const FieldPartition oldPartition = partition;
+            bool rebalancing = false;
+            if(REBALANCE_PERIOD && iteration % REBALANCE_PERIOD == 0 && generationsLeft)
+            {
+                rebalancing = checkLoadBalance(partition, computeTime, netComm);
+                computeTime = 0;
+            }
+
+            if(fieldGatherNeeded(generationsLeft))
+                MPI_Send(slice.m_values.data(), slice.m_values.size(),
+                         MPI_VALUES_TYPE, mainProcessNetRank, SENT_SLICE_TAG, netComm);
 
-            --iterations;
+            if(rebalancing)
+            {
+                slice = redistributeSlice(slice, oldPartition, partition, netComm);
+                extendedSlice.reset(new DeepExtendedSlice(slice, HALO_DEPTH, TEMPORAL_TILE_BYTES));
+            }
+
+#ifdef MONITORING
+            monitorChannel.publish(slice, netComm, mainProcessNetRank, rebalancing, iteration);
+#endif
 
             MPI_Barrier(netComm);
         }
+#   endif
+#endif
 
         calculationTime = MPI_Wtime() - calculationTime;
         printf("Process %d/%d execution time: %.6f\n", m_rank, m_processesCount, calculationTime);
@@ -268,8 +1022,10 @@ public:
      */
     LabMainProcess(const int size):
         MainProcess(size),
-        m_field(FIELD_X_SIZE, FIELD_Y_SIZE)
+        m_field(FIELD_X_SIZE, FIELD_Y_SIZE),
+        m_partition(size)
     {
+#if !defined(OUT_OF_CORE) && !defined(ENSEMBLE)
         const FieldStrides fieldStrides = getFieldStrides(m_processesCount);
         const size_t strideX = fieldStrides.first;
         const size_t strideY = fieldStrides.second;
@@ -295,17 +1051,24 @@ public:
                 m_field.m_slices.push_back(slice);
 #endif
             }
+#endif
     }
 
     virtual void execute()
     {
         double mainTime = MPI_Wtime();
 
-        MPI_Status status;
-
+#if defined(ENSEMBLE)
+        doEnsembleLife(m_rank, m_processesCount);
+#else
         MPI_Comm netComm;
         createNetCommunicator(&netComm, m_processesCount);
 
+#   ifdef OUT_OF_CORE
+        doOutOfCoreLife(netComm, m_processesCount);
+#   else
+        MPI_Status status;
+
         int netRank;
         MPI_Comm_rank (MPI_COMM_WORLD, &netRank);
 
@@ -322,17 +1085,36 @@ public:
 
         MPI_Barrier(netComm);
 
-        ExtendedSlice extendedSlice(m_field.m_slices[mySliceNumber]);
-
-        size_t iterations = ITERATIONS;
-        while(iterations)
+        std::unique_ptr<DeepExtendedSlice> extendedSlice(
+                    new DeepExtendedSlice(m_field.m_slices[mySliceNumber], HALO_DEPTH, TEMPORAL_TILE_BYTES));
+
+        CycleDetector cycleDetector;
+        size_t generationsLeft = ITERATIONS * STEPS_PER_ITERATION;
+        size_t iteration = 0;
+        double computeTime = 0;
+#ifdef MONITORING
+        int mainProcessNetRank;
+        MPI_Comm_rank(netComm, &mainProcessNetRank);
+        MonitorChannel monitorChannel;
+#endif
+#ifdef LIVE_FEED
+        LiveFeedWriter liveFeed(FIELD_X_SIZE, FIELD_Y_SIZE);
+#endif
+        while(generationsLeft)
         {
-            --iterations;
+            doLifeSteps(*extendedSlice, netComm, cycleDetector, generationsLeft, computeTime);
 
-            doLifeSteps(extendedSlice, netComm);
+            ++iteration;
+            const FieldPartition oldPartition = m_partition;
+            bool rebalancing = false;
+            if(REBALANCE_PERIOD && iteration % REBALANCE_PERIOD == 0 && generationsLeft)
+            {
+                rebalancing = checkLoadBalance(m_partition, computeTime, netComm);
+                computeTime = 0;
+            }
 
             //Собираем куски поля
-            for(int process = 0; process < m_processesCount - 1; ++process)
+            for(int process = 0; fieldGatherNeeded(generationsLeft) && process < m_processesCount - 1; ++process)
             {
 
                 MPI_Probe(MPI_ANY_SOURCE, SENT_SLICE_TAG, netComm, &status);
@@ -349,18 +1131,51 @@ public:
             }
 #endif
 
+#ifdef SNAPSHOT_SAVE
+            writeSnapshot(SNAPSHOT_FILE, m_field);
+#endif
+
+#ifdef LIVE_FEED
+            liveFeed.publish(m_field, iteration);
+#endif
+
+            if(rebalancing)
+            {
+                m_field.m_slices[mySliceNumber] =
+                    redistributeSlice(m_field.m_slices[mySliceNumber], oldPartition, m_partition, netComm);
+                //Остальные куски собранного поля устарели, размеры приемных буферов берутся из нового разбиения
+                for(size_t index = 0; index < m_field.m_slices.size(); ++index)
+                    if(index != mySliceNumber)
+                        m_field.m_slices[index] = m_partition.makeZeroSlice(index);
+                extendedSlice.reset(
+                    new DeepExtendedSlice(m_field.m_slices[mySliceNumber], HALO_DEPTH, TEMPORAL_TILE_BYTES));
+            }
+
+#ifdef MONITORING
+            monitorChannel.publish(m_field.m_slices[mySliceNumber], netComm, mainProcessNetRank, rebalancing, iteration);
+#endif
+
 #ifdef DELAYS
             std::this_thread::sleep_for(std::chrono::milliseconds(DELAY));
 #endif
             MPI_Barrier(netComm);
         }
+#   endif
+#endif
 
         mainTime = MPI_Wtime() - mainTime;
         printf("Main process %d/%d execution time: %.6f\n", m_rank, m_processesCount, mainTime);
+
+#if !defined(ENSEMBLE) && !defined(OUT_OF_CORE)
+        if(cycleDetector.period())
+            printf("Field reached a cycle with period %zu at generation %zu\n",
+                   cycleDetector.period() * HALO_DEPTH, cycleDetector.detectionGeneration() * HALO_DEPTH);
+#endif
     }
 
 private:
     Field m_field;
+    FieldPartition m_partition;//!< Текущее разбиение поля по процессам
 
 }; // end of MainProcess
 
@@ -381,6 +1196,7 @@ int main(int argc, char *argv[])
     MPI_Comm_rank (MPI_COMM_WORLD, &rank);        /* get current process id */
     MPI_Comm_size (MPI_COMM_WORLD, &size);        /* get number of processes */
 
+#ifndef ENSEMBLE
     if(!assertFieldSize(size))
     {
        if(rank == 0)
@@ -388,6 +1204,7 @@ int main(int argc, char *argv[])
        MPI_Finalize(); /* ends MPI */
        return 0;
     }
+#endif
 
     std::unique_ptr<Process> process = makeProcess(rank, size);
     process->execute();
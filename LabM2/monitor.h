@@ -0,0 +1,107 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+//Наблюдатель - внешняя программа: запрос пишется в MONITOR_REQUEST_FILE одной строкой текста
+//"x y width height factor" (лучше через временный файл и rename), кадр читается из MONITOR_FRAME_FILE
+//как MonitorFrame в boost binary_oarchive
+const char MONITOR_REQUEST_FILE[] = "monitor.req";//!< Файл запроса наблюдателя (текст: x y width height factor)
+const char MONITOR_FRAME_FILE[] = "monitor.dat";//!< Файл кадра наблюдения
+
+/*!
+ * \brief Запрос наблюдателя: прямоугольник поля и коэффициент прореживания
+ */
+struct MonitorRequest
+{
+    uint64_t m_x;
+    uint64_t m_y;
+    uint64_t m_width;
+    uint64_t m_height;
+    uint64_t m_factor;//!< Сторона блока, население которого суммируется в одну точку кадра
+
+    size_t columns() const
+    {
+        return (m_width + m_factor - 1) / m_factor;
+    }
+
+    size_t rows() const
+    {
+        return (m_height + m_factor - 1) / m_factor;
+    }
+};
+
+inline bool operator==(const MonitorRequest& lhs, const MonitorRequest& rhs)
+{
+    return lhs.m_x == rhs.m_x &&
+           lhs.m_y == rhs.m_y &&
+           lhs.m_width == rhs.m_width &&
+           lhs.m_height == rhs.m_height &&
+           lhs.m_factor == rhs.m_factor;
+}
+
+/*!
+ * \brief Кадр наблюдения: количество живых клеток в каждом блоке m_factor x m_factor
+ * прямоугольника запроса (построчно, columns() x rows())
+ */
+struct MonitorFrame
+{
+    MonitorFrame():
+        m_request{0, 0, 0, 0, 1},
+        m_iteration{0}
+    {}
+
+    MonitorRequest m_request;
+    uint64_t m_iteration;//!< Номер итерации, на которой снят кадр
+    std::vector<uint32_t> m_population;
+};
+
+/*!
+ * \brief Читает запрос наблюдателя из файла
+ * \param request прочитанный запрос (не меняется при ошибке)
+ * \return true если запрос прочитан
+ */
+inline bool readMonitorRequest(MonitorRequest& request)
+{
+    std::ifstream is(MONITOR_REQUEST_FILE);
+    MonitorRequest result;
+    if(!(is >> result.m_x >> result.m_y >> result.m_width >> result.m_height >> result.m_factor))
+        return false;
+    if(!result.m_width || !result.m_height || !result.m_factor)
+        return false;
+
+    request = result;
+    return true;
+}
+
+namespace boost
+{
+    namespace serialization
+    {
+        template<class Archive>
+        void serialize(Archive& ar, MonitorRequest& request, const unsigned int version)
+        {
+            ar & request.m_x;
+            ar & request.m_y;
+            ar & request.m_width;
+            ar & request.m_height;
+            ar & request.m_factor;
+        }
+
+        template<class Archive>
+        void serialize(Archive& ar, MonitorFrame& frame, const unsigned int version)
+        {
+            ar & frame.m_request;
+            ar & frame.m_iteration;
+            ar & frame.m_population;
+        }
+    }
+}
+
+#endif // MONITOR_H
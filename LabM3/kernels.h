@@ -0,0 +1,346 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "lab3types.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+/*
+ * Вычислительные ядра метода сопряженных градиентов.
+ * Векторизация явная, через векторные типы GCC/Clang: без -ffast-math компилятор не переставляет
+ * слагаемые суммы и сам редукции не векторизует. Ширина вектора берется по доступному набору команд:
+ * при сборке с -march=native (AVX2/FMA) - 256 бит и умножение со сложением сливается в FMA,
+ * иначе - 128 бит SSE2.
+ */
+
+#ifdef __AVX__
+const size_t SIMD_WIDTH = 32 / sizeof(values_t);//!< Значений в векторе
+#else
+const size_t SIMD_WIDTH = 16 / sizeof(values_t);
+#endif
+const size_t GEMV_ROWS = 4;//!< Строк матрицы, умножаемых за один проход по вектору
+const size_t GEMV_COLUMN_BLOCK = 2048;//!< Ширина блока столбцов: часть вектора (16 КБ) остается в L1 на все строки
+
+typedef values_t simd_t __attribute__((vector_size(SIMD_WIDTH * sizeof(values_t))));
+typedef float float_simd_t __attribute__((vector_size(SIMD_WIDTH * sizeof(float))));
+
+inline simd_t simdLoad(const values_t* values)
+{
+    simd_t result;
+    std::memcpy(&result, values, sizeof(result));
+    return result;
+}
+
+/*!
+ * \brief Загрузка матрицы одинарной точности с расширением до values_t (счет идет в values_t)
+ */
+inline simd_t simdLoad(const float* values)
+{
+    float_simd_t result;
+    std::memcpy(&result, values, sizeof(result));
+    return __builtin_convertvector(result, simd_t);
+}
+
+inline void simdStore(values_t* values, const simd_t vector)
+{
+    std::memcpy(values, &vector, sizeof(vector));
+}
+
+inline simd_t simdBroadcast(const values_t value)
+{
+    simd_t result;
+    for(size_t index = 0; index < SIMD_WIDTH; ++index)
+        result[index] = value;
+    return result;
+}
+
+inline values_t simdSum(const simd_t vector)
+{
+    values_t result = 0;
+    for(size_t index = 0; index < SIMD_WIDTH; ++index)
+        result += vector[index];
+    return result;
+}
+
+/*!
+ * \brief Скалярное произведение
+ * \tparam M тип элементов первого вектора (values_t или float для строки матрицы одинарной точности)
+ */
+template<typename M>
+values_t dot(const M* __restrict first, const values_t* __restrict second, const size_t size)
+{
+    //Четыре независимых накопителя скрывают задержку сложения
+    simd_t sum0 = {}, sum1 = {}, sum2 = {}, sum3 = {};
+    size_t index = 0;
+    for(; index + 4 * SIMD_WIDTH <= size; index += 4 * SIMD_WIDTH)
+    {
+        sum0 += simdLoad(first + index) * simdLoad(second + index);
+        sum1 += simdLoad(first + index + SIMD_WIDTH) * simdLoad(second + index + SIMD_WIDTH);
+        sum2 += simdLoad(first + index + 2 * SIMD_WIDTH) * simdLoad(second + index + 2 * SIMD_WIDTH);
+        sum3 += simdLoad(first + index + 3 * SIMD_WIDTH) * simdLoad(second + index + 3 * SIMD_WIDTH);
+    }
+
+    values_t result = simdSum((sum0 + sum1) + (sum2 + sum3));
+    for(; index < size; ++index)
+        result += first[index] * second[index];
+    return result;
+}
+
+/*!
+ * \brief destination += alpha * source
+ */
+inline void axpy(const values_t alpha, const values_t* __restrict source, values_t* __restrict destination,
+                 const size_t size)
+{
+    for(size_t index = 0; index < size; ++index)
+        destination[index] += alpha * source[index];
+}
+
+/*!
+ * \brief destination = source + betta * destination
+ */
+inline void xpay(const values_t* __restrict source, const values_t betta, values_t* __restrict destination,
+                 const size_t size)
+{
+    for(size_t index = 0; index < size; ++index)
+        destination[index] = source[index] + betta * destination[index];
+}
+
+/*!
+ * \brief Слитый шаг метода сопряженных градиентов за один проход по памяти:
+ * solution += alpha * direction, residual -= alpha * product
+ * \return (residual, residual) после обновления
+ */
+inline values_t cgStep(const values_t alpha, const values_t* __restrict direction, const values_t* __restrict product,
+                       values_t* __restrict solution, values_t* __restrict residual, const size_t size)
+{
+    const simd_t alphas = simdBroadcast(alpha);
+    simd_t sum0 = {}, sum1 = {};
+    size_t index = 0;
+    for(; index + 2 * SIMD_WIDTH <= size; index += 2 * SIMD_WIDTH)
+    {
+        const simd_t residual0 = simdLoad(residual + index) - alphas * simdLoad(product + index);
+        const simd_t residual1 = simdLoad(residual + index + SIMD_WIDTH) - alphas * simdLoad(product + index + SIMD_WIDTH);
+        simdStore(residual + index, residual0);
+        simdStore(residual + index + SIMD_WIDTH, residual1);
+        simdStore(solution + index, simdLoad(solution + index) + alphas * simdLoad(direction + index));
+        simdStore(solution + index + SIMD_WIDTH,
+                  simdLoad(solution + index + SIMD_WIDTH) + alphas * simdLoad(direction + index + SIMD_WIDTH));
+        sum0 += residual0 * residual0;
+        sum1 += residual1 * residual1;
+    }
+
+    values_t result = simdSum(sum0 + sum1);
+    for(; index < size; ++index)
+    {
+        solution[index] += alpha * direction[index];
+        residual[index] -= alpha * product[index];
+        result += residual[index] * residual[index];
+    }
+    return result;
+}
+
+/*!
+ * \brief Слитый шаг конвейерного метода сопряженных градиентов (Ghysels, Vanroose) за один проход:
+ * z = q + betta z, s = w + betta s, p = r + betta p, x += alpha p, r -= alpha s, w -= alpha z
+ * \param gamma (r, r) после обновления
+ * \param delta (w, r) после обновления
+ */
+inline void pipelinedCgStep(const values_t alpha, const values_t betta, const values_t* __restrict q,
+                            values_t* __restrict z, values_t* __restrict s, values_t* __restrict p,
+                            values_t* __restrict x, values_t* __restrict r, values_t* __restrict w,
+                            const size_t size, values_t& gamma, values_t& delta)
+{
+    const simd_t alphas = simdBroadcast(alpha);
+    const simd_t bettas = simdBroadcast(betta);
+    simd_t gammaSum = {}, deltaSum = {};
+    size_t index = 0;
+    for(; index + SIMD_WIDTH <= size; index += SIMD_WIDTH)
+    {
+        const simd_t zValue = simdLoad(q + index) + bettas * simdLoad(z + index);
+        const simd_t sValue = simdLoad(w + index) + bettas * simdLoad(s + index);
+        const simd_t pValue = simdLoad(r + index) + bettas * simdLoad(p + index);
+        const simd_t rValue = simdLoad(r + index) - alphas * sValue;
+        const simd_t wValue = simdLoad(w + index) - alphas * zValue;
+        simdStore(z + index, zValue);
+        simdStore(s + index, sValue);
+        simdStore(p + index, pValue);
+        simdStore(x + index, simdLoad(x + index) + alphas * pValue);
+        simdStore(r + index, rValue);
+        simdStore(w + index, wValue);
+        gammaSum += rValue * rValue;
+        deltaSum += wValue * rValue;
+    }
+
+    gamma = simdSum(gammaSum);
+    delta = simdSum(deltaSum);
+    for(; index < size; ++index)
+    {
+        z[index] = q[index] + betta * z[index];
+        s[index] = w[index] + betta * s[index];
+        p[index] = r[index] + betta * p[index];
+        x[index] += alpha * p[index];
+        r[index] -= alpha * s[index];
+        w[index] -= alpha * z[index];
+        gamma += r[index] * r[index];
+        delta += w[index] * r[index];
+    }
+}
+
+/*!
+ * \brief result[0..GEMV_ROWS) += строки x vector на отрезке столбцов [0, columns)
+ */
+template<typename M>
+void gemvRows(const M* __restrict matrix, const size_t leading, const size_t columns,
+                     const values_t* __restrict vector, values_t* __restrict result)
+{
+    //По два накопителя на строку: элемент вектора загружается один раз на все строки
+    simd_t sum[GEMV_ROWS][2] = {};
+    size_t column = 0;
+    for(; column + 2 * SIMD_WIDTH <= columns; column += 2 * SIMD_WIDTH)
+    {
+        const simd_t first = simdLoad(vector + column);
+        const simd_t second = simdLoad(vector + column + SIMD_WIDTH);
+        for(size_t row = 0; row < GEMV_ROWS; ++row)
+        {
+            sum[row][0] += simdLoad(matrix + row * leading + column) * first;
+            sum[row][1] += simdLoad(matrix + row * leading + column + SIMD_WIDTH) * second;
+        }
+    }
+
+    for(size_t row = 0; row < GEMV_ROWS; ++row)
+    {
+        values_t value = simdSum(sum[row][0] + sum[row][1]);
+        for(size_t tail = column; tail < columns; ++tail)
+            value += matrix[row * leading + tail] * vector[tail];
+        result[row] += value;
+    }
+}
+
+/*!
+ * \brief Умножение блока строк плотной матрицы на вектор.
+ * Столбцы обходятся блоками по GEMV_COLUMN_BLOCK, внутри блока - группами по GEMV_ROWS строк.
+ * \tparam M тип элементов матрицы (values_t или float - вдвое меньше байт на проход, счет в values_t)
+ * \param matrix строки матрицы
+ * \param leading расстояние между началами строк
+ * \param rows количество строк
+ * \param columns количество столбцов (размер вектора)
+ * \param vector вектор
+ * \param result rows значений
+ */
+template<typename M>
+void gemv(const M* matrix, const size_t leading, const size_t rows, const size_t columns,
+                 const values_t* vector, values_t* result)
+{
+    std::fill(result, result + rows, values_t(0));
+
+    for(size_t block = 0; block < columns; block += GEMV_COLUMN_BLOCK)
+    {
+        const size_t width = std::min(GEMV_COLUMN_BLOCK, columns - block);
+        size_t row = 0;
+        for(; row + GEMV_ROWS <= rows; row += GEMV_ROWS)
+            gemvRows(matrix + row * leading + block, leading, width, vector + block, result + row);
+
+        for(; row < rows; ++row)
+            result[row] += dot(matrix + row * leading + block, vector + block, width);
+    }
+}
+
+/*!
+ * \brief Умножение блока строк плотной матрицы на K векторов, записанных вперемешку
+ * (элемент c вектора j лежит в block[c * K + j]). Каждая строка матрицы читается один раз на все K векторов,
+ * две строки обрабатываются вместе, чтобы каждый элемент блока векторов загружался один раз на две строки.
+ * \param matrix строки матрицы
+ * \param leading расстояние между началами строк
+ * \param rows количество строк
+ * \param columns количество столбцов
+ * \param block K векторов вперемешку (columns * K значений)
+ * \param result rows * K значений вперемешку
+ */
+template<size_t K, typename M>
+void gemm(const M* matrix, const size_t leading, const size_t rows, const size_t columns,
+          const values_t* __restrict block, values_t* __restrict result)
+{
+    const size_t columnBlock = std::max<size_t>(GEMV_COLUMN_BLOCK / K, SIMD_WIDTH);
+    std::fill(result, result + rows * K, values_t(0));
+
+    for(size_t first = 0; first < columns; first += columnBlock)
+    {
+        const size_t last = std::min(first + columnBlock, columns);
+        for(size_t row = 0; row < rows; row += 2)
+        {
+            const M* __restrict upper = matrix + row * leading;
+            const M* __restrict lower = row + 1 < rows ? upper + leading : upper;
+
+            values_t upperSum[K] = {}, lowerSum[K] = {};
+            for(size_t column = first; column < last; ++column)
+            {
+                const values_t upperValue = upper[column];
+                const values_t lowerValue = lower[column];
+                const values_t* __restrict vectors = block + column * K;
+                for(size_t vector = 0; vector < K; ++vector)
+                {
+                    upperSum[vector] += upperValue * vectors[vector];
+                    lowerSum[vector] += lowerValue * vectors[vector];
+                }
+            }
+
+            for(size_t vector = 0; vector < K; ++vector)
+                result[row * K + vector] += upperSum[vector];
+            if(row + 1 < rows)
+                for(size_t vector = 0; vector < K; ++vector)
+                    result[(row + 1) * K + vector] += lowerSum[vector];
+        }
+    }
+}
+
+/*!
+ * \brief Скалярные произведения K пар векторов, записанных вперемешку: result[j] = (first_j, second_j)
+ */
+template<size_t K>
+void blockDot(const values_t* __restrict first, const values_t* __restrict second, const size_t rows,
+              values_t* result)
+{
+    values_t sum[K] = {};
+    for(size_t row = 0; row < rows; ++row)
+        for(size_t vector = 0; vector < K; ++vector)
+            sum[vector] += first[row * K + vector] * second[row * K + vector];
+    std::copy(sum, sum + K, result);
+}
+
+/*!
+ * \brief Шаг метода для K систем (cgStep со своим alpha у каждой)
+ * \param residualDots (residual_j, residual_j) после обновления
+ */
+template<size_t K>
+void blockCgStep(const values_t* alpha, const values_t* __restrict direction, const values_t* __restrict product,
+                 values_t* __restrict solution, values_t* __restrict residual, const size_t rows,
+                 values_t* residualDots)
+{
+    values_t sum[K] = {};
+    for(size_t row = 0; row < rows; ++row)
+        for(size_t vector = 0; vector < K; ++vector)
+        {
+            const size_t index = row * K + vector;
+            solution[index] += alpha[vector] * direction[index];
+            residual[index] -= alpha[vector] * product[index];
+            sum[vector] += residual[index] * residual[index];
+        }
+    std::copy(sum, sum + K, residualDots);
+}
+
+/*!
+ * \brief destination_j = source_j + betta_j * destination_j для K векторов вперемешку
+ */
+template<size_t K>
+void blockXpay(const values_t* __restrict source, const values_t* betta, values_t* __restrict destination,
+               const size_t rows)
+{
+    for(size_t row = 0; row < rows; ++row)
+        for(size_t vector = 0; vector < K; ++vector)
+            destination[row * K + vector] = source[row * K + vector] + betta[vector] * destination[row * K + vector];
+}
+
+#endif // KERNELS_H
@@ -0,0 +1,7 @@
+#ifndef LAB3TYPES_H
+#define LAB3TYPES_H
+
+typedef double values_t;
+#define MPI_VALUES_TYPE MPI_DOUBLE
+
+#endif // LAB3TYPES_H
@@ -6,37 +6,406 @@
 
 
 #include "utils.h"
+#include "lab3types.h"
+#include "kernels.h"
+#include "threadpool.h"
+
+//Матрица A хранится в разреженном виде (CSR), вектор направления собирается обменом с соседями
+//#define SPARSE_MATRIX
+
+//Конвейерный метод сопряженных градиентов: одна неблокирующая редукция за итерацию,
+//совмещенная с обменом и умножением матрицы на вектор
+//#define PIPELINED_CG
+
+//Предобуславливатель метода сопряженных градиентов:
+//PRECONDITIONER_JACOBI - диагональ матрицы;
+//PRECONDITIONER_BLOCK_JACOBI - свой диагональный блок процесса: плотный раскладывается точно (Холецкий),
+//разреженный - неполно, IC(0)
+#define PRECONDITIONER_JACOBI 1
+#define PRECONDITIONER_BLOCK_JACOBI 2
+//#define PRECONDITIONER PRECONDITIONER_JACOBI
+
+#if defined(PRECONDITIONER) && defined(PIPELINED_CG)
+#error "PRECONDITIONER is incompatible with PIPELINED_CG"
+#endif
+
+//Двумерное разбиение плотной матрицы на решетке процессов sqrt(p) x sqrt(p):
+//процесс передает за итерацию O(N / sqrt(p)) значений вместо O(N)
+//#define BLOCK_2D
+
+#if defined(BLOCK_2D) && (defined(SPARSE_MATRIX) || defined(PRECONDITIONER))
+#error "BLOCK_2D is incompatible with SPARSE_MATRIX and PRECONDITIONER"
+#endif
+
+//Плотная матрица хранится в одинарной точности (старшая и младшая части значения): итерации метода
+//читают только старшие части - вдвое меньше байт, точность двойная восстанавливается итерационным уточнением
+//#define MIXED_PRECISION
+
+#if defined(MIXED_PRECISION) && defined(SPARSE_MATRIX)
+#error "MIXED_PRECISION is incompatible with SPARSE_MATRIX"
+#endif
+
+//Блочный вариант: BLOCK_CG систем с общей матрицей и разными правыми частями решаются вместе.
+//Векторы систем хранятся вперемешку, поэтому каждая строка матрицы читается один раз на все системы,
+//а скалярные произведения всех систем собираются одной редукцией
+//#define BLOCK_CG 8
+
+#if defined(BLOCK_CG) && (defined(SPARSE_MATRIX) || defined(PIPELINED_CG) || defined(PRECONDITIONER) || \
+                          defined(BLOCK_2D) || defined(MIXED_PRECISION))
+#error "BLOCK_CG is incompatible with SPARSE_MATRIX, PIPELINED_CG, PRECONDITIONER, BLOCK_2D and MIXED_PRECISION"
+#endif
+
+//Матрица A читается из файла: собственного двоичного формата (см. matrixloader.h) или Matrix Market.
+//Каждый процесс читает только свои строки, размер матрицы должен быть N
+//#define MATRIX_FILE "matrix.mtx"
+
+//Матрица A (прочитанная или сгенерированная разреженная) сохраняется в двоичном формате
+//для быстрого повторного чтения
+//#define MATRIX_SAVE_FILE "matrix.csr"
+
+#if defined(MATRIX_FILE) && defined(BLOCK_2D)
+#error "MATRIX_FILE is incompatible with BLOCK_2D"
+#endif
+
+#if defined(MATRIX_SAVE_FILE) && !defined(MATRIX_FILE) && !defined(SPARSE_MATRIX)
+#error "MATRIX_SAVE_FILE requires MATRIX_FILE or SPARSE_MATRIX"
+#endif
+
+//Гибридный режим: процесс на узел NUMA (mpirun --map-by numa --bind-to numa), внутри него - по потоку
+//на каждый доступный процессор, потоки привязаны к своим процессорам (процессы с общей маской делят ее между собой). Копий вектора направления
+//и участников MPI_Allgatherv столько же, сколько узлов NUMA, а не ядер
+//#define HYBRID_NUMA
+
+#ifdef SPARSE_MATRIX
+#include "sparsematrix.h"
+#endif
+
+#if defined(MATRIX_FILE) || defined(MATRIX_SAVE_FILE)
+#include "matrixloader.h"
+#endif
+
+#ifdef BLOCK_2D
+#include "processgrid.h"
+#endif
+
+#ifdef PRECONDITIONER
+#include "preconditioner.h"
+#endif
 
 #include <memory>
 #include <vector>
 #include <iostream>
 
-#include <ctime>
-#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <thread>
 
 const size_t N = 10200;//!< Размер системы уравнений
-const size_t ITERATIONS = 1000;
+const size_t ITERATIONS = 1000;//!< Наибольшее количество итераций
+const values_t TOLERANCE = 1e-10;//!< Итерации прекращаются, когда |r| / |B| не больше этого значения
+
+#ifdef BLOCK_CG
+const size_t RIGHT_HAND_SIDES = BLOCK_CG;//!< Количество правых частей (систем)
+#else
+const size_t RIGHT_HAND_SIDES = 1;
+#endif
+
+#ifdef MIXED_PRECISION
+typedef float matrix_values_t;//!< Тип хранения плотной матрицы
+const size_t REFINEMENT_STEPS = 10;//!< Наибольшее количество шагов уточнения
+const values_t INNER_TOLERANCE = 1e-6;//!< Относительная точность поправки (около точности float)
+#else
+typedef values_t matrix_values_t;
+#endif
+const size_t THREAD_DOT_STRIDE = 64 / sizeof(values_t);//!< Частичные суммы потоков лежат в разных строках кэша
+const size_t AFFINITY_MASK_BYTES = 128;//!< Размер маски привязки, которой обмениваются процессы узла (1024 процессора)
+
+const uint64_t MATRIX_SEED = 0x4c61624d33ull;//!< Зерно значений матрицы A
+const uint64_t B_VECTOR_SEED = 0x4c61624d3362ull;//!< Зерно значений вектора B
 
-//Типы элементов
-typedef double values_t;
-#define MPI_VALUES_TYPE MPI_DOUBLE
+#ifdef SPARSE_MATRIX
+//Смещения внедиагональных элементов строки (портрет симметричен: элементы стоят в столбцах row +- offset)
+const size_t SPARSE_OFFSETS[] = {1, 7, 61, 503, 4093};
+#endif
 
-int getStride(int processesCount)
+/*!
+ * \brief Псевдослучайное значение, зависящее только от зерна и пары номеров (splitmix64).
+ * Заменяет последовательный rand(): любой элемент вычисляется независимо, поэтому каждый процесс
+ * строит свои строки сам, без главного процесса и без обмена.
+ */
+uint64_t pairHash(const uint64_t seed, const uint64_t first, const uint64_t second)
+{
+    uint64_t value = seed ^ (first * 0x9e3779b97f4a7c15ull) ^ (second + 0x632be59bd9b4e019ull);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+/*!
+ * \brief Элемент матрицы A. Зависит только от неупорядоченной пары номеров - матрица симметрична.
+ * Случайная часть вне диагонали имеет собственные значения до 6 sqrt(N) по модулю, диагональ больше -
+ * матрица положительно определена и метод сходится.
+ */
+values_t aMatrixValue(const size_t row, const size_t column)
+{
+    const uint64_t value = pairHash(MATRIX_SEED, std::min(row, column), std::max(row, column));
+    if(row == column)
+        return std::sqrt(static_cast<values_t>(N)) * (8 + value % 8);
+    return value % 10;
+}
+
+/*!
+ * \brief Элемент вектора B
+ * \param rightHandSide номер правой части (при BLOCK_CG)
+ */
+values_t bVectorValue(const size_t row, const size_t rightHandSide = 0)
 {
-  return N / processesCount;
+    return pairHash(B_VECTOR_SEED, row, rightHandSide) % 10;
 }
 
+#ifdef SPARSE_MATRIX
+/*!
+ * \brief Внедиагональный элемент разреженной матрицы (симметричен так же, как aMatrixValue)
+ */
+values_t sparseValue(const size_t row, const size_t column)
+{
+    return -static_cast<values_t>(1 + pairHash(MATRIX_SEED, std::min(row, column), std::max(row, column)) % 9);
+}
+
+/*!
+ * \brief Строит блок строк разреженной матрицы с глобальными номерами столбцов.
+ * Диагональ больше суммы модулей остальных элементов строки - матрица симметрична и положительно определена.
+ * \param firstRow первая строка блока
+ * \param rowsCount количество строк
+ */
+CsrMatrix makeSparseRows(const size_t firstRow, const size_t rowsCount)
+{
+    CsrMatrix matrix;
+    const size_t offsetsCount = sizeof(SPARSE_OFFSETS) / sizeof(SPARSE_OFFSETS[0]);
+    matrix.m_columns.reserve(rowsCount * (2 * offsetsCount + 1));
+    matrix.m_values.reserve(rowsCount * (2 * offsetsCount + 1));
+
+    for(size_t row = firstRow; row < firstRow + rowsCount; ++row)
+    {
+        values_t diagonal = 1;
+        for(size_t offset = offsetsCount; offset > 0; --offset)
+            if(row >= SPARSE_OFFSETS[offset - 1])
+            {
+                const size_t column = row - SPARSE_OFFSETS[offset - 1];
+                matrix.append(column, sparseValue(row, column));
+                diagonal -= sparseValue(row, column);
+            }
+
+        const size_t diagonalIndex = matrix.nonZeros();
+        matrix.append(row, 0);
+
+        for(size_t offset = 0; offset < offsetsCount; ++offset)
+            if(row + SPARSE_OFFSETS[offset] < N)
+            {
+                const size_t column = row + SPARSE_OFFSETS[offset];
+                matrix.append(column, sparseValue(row, column));
+                diagonal -= sparseValue(row, column);
+            }
+
+        matrix.m_values[diagonalIndex] = diagonal;
+        matrix.finishRow();
+    }
+    return matrix;
+}
+#endif
+
+#if defined(SPARSE_MATRIX) && !defined(MATRIX_FILE)
+/*!
+ * \brief Количество ненулевых элементов строки сгенерированной разреженной матрицы (как в makeSparseRows)
+ */
+size_t sparseRowNonZeros(const size_t row)
+{
+    size_t nonZeros = 1;
+    for(const size_t offset : SPARSE_OFFSETS)
+        nonZeros += (row >= offset) + (row + offset < N);
+    return nonZeros;
+}
+#endif
+
+/*!
+ * \brief Первая строка каждого процесса (processesCount + 1 значений, последнее - N).
+ * Количество строк процессов может быть любым: плотная матрица делится поровну по строкам
+ * (доли отличаются не больше чем на строку), сгенерированная разреженная - поровну по ненулевым элементам.
+ * Разбиение прочитанной из файла матрицы - по строкам: ее портрет до чтения неизвестен.
+ * При двумерном разбиении N делится на количество процессов нацело и доли одинаковы.
+ */
+std::vector<size_t> getRowStarts(const int processesCount)
+{
+    std::vector<size_t> rowStarts(processesCount + 1, N);
+#if defined(SPARSE_MATRIX) && !defined(MATRIX_FILE)
+    size_t totalNonZeros = 0;
+    for(size_t row = 0; row < N; ++row)
+        totalNonZeros += sparseRowNonZeros(row);
+
+    //Процесс начинается со строки, перед которой накоплена его доля ненулевых элементов
+    size_t nonZeros = 0;
+    int process = 0;
+    for(size_t row = 0; row < N; ++row)
+    {
+        while(process < processesCount && nonZeros >= totalNonZeros * process / processesCount)
+            rowStarts[process++] = row;
+        nonZeros += sparseRowNonZeros(row);
+    }
+#else
+    for(int process = 0; process < processesCount; ++process)
+        rowStarts[process] = N * process / processesCount;
+#endif
+    return rowStarts;
+}
+
+#if defined(SPARSE_MATRIX) || defined(MATRIX_FILE)
+/*!
+ * \brief Строки матрицы A процесса с глобальными номерами столбцов: прочитанные из файла или сгенерированные
+ * (коллективная операция при MATRIX_FILE и MATRIX_SAVE_FILE)
+ * \param rowStarts первая строка каждого процесса
+ */
+CsrMatrix makeMatrixRows(const std::vector<size_t>& rowStarts, const int rank)
+{
+#ifdef MATRIX_FILE
+    (void)rank;
+    CsrMatrix matrix = loadMatrixRows(MATRIX_FILE, rowStarts);
+#else
+    CsrMatrix matrix = makeSparseRows(rowStarts[rank], rowStarts[rank + 1] - rowStarts[rank]);
+#endif
+#ifdef MATRIX_SAVE_FILE
+    saveMatrixRows(MATRIX_SAVE_FILE, matrix, rowStarts);
+#endif
+    return matrix;
+}
+#endif
+
+/*!
+ * \brief Процессоры для привязки потоков процесса (пусто - потоки не привязываются).
+ * Каждый процесс привязывает потоки только к своей доле маски (см. getProcessCpus), поэтому процессы
+ * с общей маской не занимают одни и те же первые процессоры; процесс без своей доли не привязывается.
+ * \param processCpus свои процессоры процесса
+ */
+std::vector<int> getThreadsCpus(const std::vector<int>& processCpus)
+{
+#ifdef HYBRID_NUMA
+    return processCpus;
+#else
+    (void)processCpus;
+    return std::vector<int>();
+#endif
+}
+
+/*!
+ * \brief Доля процессоров узла для процесса: процессоры, к которым привязан процесс, делятся поровну
+ * между процессами узла с той же привязкой (без привязки - все процессоры между всеми процессами узла).
+ * Коллективная операция.
+ * \return свои процессоры процесса; пусто, если процессов с той же привязкой больше, чем процессоров
+ */
+std::vector<int> getProcessCpus()
+{
+    std::vector<int> cpus = ThreadPool::affinityCpus();
+    if(cpus.empty())
+        for(unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+            cpus.push_back(cpu);
+
+    std::vector<unsigned char> mask(AFFINITY_MASK_BYTES, 0);
+    for(const int cpu : cpus)
+        if(static_cast<size_t>(cpu) < AFFINITY_MASK_BYTES * 8)
+            mask[cpu / 8] |= 1u << cpu % 8;
+
+    MPI_Comm nodeComm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodeComm);
+    int nodeRank, nodeProcessesCount;
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    MPI_Comm_size(nodeComm, &nodeProcessesCount);
+    std::vector<unsigned char> masks(AFFINITY_MASK_BYTES * nodeProcessesCount);
+    MPI_Allgather(mask.data(), AFFINITY_MASK_BYTES, MPI_UNSIGNED_CHAR,
+                  masks.data(), AFFINITY_MASK_BYTES, MPI_UNSIGNED_CHAR, nodeComm);
+    MPI_Comm_free(&nodeComm);
+
+    //Номер процесса среди процессов узла с той же маской привязки и их количество
+    size_t sharersCount = 0;
+    size_t sharerIndex = 0;
+    for(int process = 0; process < nodeProcessesCount; ++process)
+        if(std::equal(mask.begin(), mask.end(), masks.begin() + process * AFFINITY_MASK_BYTES))
+        {
+            if(process < nodeRank)
+                ++sharerIndex;
+            ++sharersCount;
+        }
+
+    const size_t begin = cpus.size() * sharerIndex / sharersCount;
+    const size_t end = cpus.size() * (sharerIndex + 1) / sharersCount;
+    return std::vector<int>(cpus.begin() + begin, cpus.begin() + end);
+}
+
+/*!
+ * \brief Количество потоков процесса: по потоку на каждый свой процессор (см. getProcessCpus)
+ * \param processCpus свои процессоры процесса
+ */
+size_t getThreadsCount(const std::vector<int>& processCpus)
+{
+    return std::max<size_t>(1, processCpus.size());
+}
+
+#ifdef BLOCK_2D
+/*!
+ * \brief Сторона квадратной решетки процессов
+ */
+int getGridSide(const int processesCount)
+{
+    return static_cast<int>(std::lround(std::sqrt(processesCount)));
+}
+#endif
+
 /*!
  * \brief Проверяет соответствие размерности матрицы количеству процессов.
- * Сторона матрицы должна нацело делиться на кол-во процессов.
+ * Каждому процессу должна достаться хотя бы одна строка. При двумерном разбиении количество процессов,
+ * кроме того, должно быть квадратом, а сторона матрицы - нацело делиться на кол-во процессов.
  * \param processesCount Количество процессов
  * \return
  */
 bool assertMatrixSize(const int processesCount)
 {
-    const int stride = getStride(processesCount);
+#ifdef BLOCK_2D
+    if(getGridSide(processesCount) * getGridSide(processesCount) != processesCount)
+        return false;
+    if(N % processesCount)
+        return false;
+#endif
+
+    const std::vector<size_t> rowStarts = getRowStarts(processesCount);
+    for(int process = 0; process < processesCount; ++process)
+        if(rowStarts[process] == rowStarts[process + 1])
+            return false;
+    return true;
+}
+
+/*!
+ * \brief Нормы невязки B - A x одной системы по строкам процессов
+ */
+struct ResidualNorms
+{
+    double m_squares;//!< Сумма квадратов невязки
+    double m_bSquares;//!< Сумма квадратов B
+    double m_max;//!< Наибольший модуль невязки
+};
 
-    return (stride * processesCount) == N;
+/*!
+ * \brief Операция MPI: суммы квадратов складываются, наибольшие модули - через максимум
+ */
+void reduceResidualNorms(void* in, void* inout, int* count, MPI_Datatype*)
+{
+    const ResidualNorms* source = static_cast<const ResidualNorms*>(in);
+    ResidualNorms* result = static_cast<ResidualNorms*>(inout);
+    for(int index = 0; index < *count; ++index)
+    {
+        result[index].m_squares += source[index].m_squares;
+        result[index].m_bSquares += source[index].m_bSquares;
+        result[index].m_max = std::max(result[index].m_max, source[index].m_max);
+    }
 }
 
 /*!
@@ -52,14 +421,95 @@ public:
      * \param size общее число запущенных процессов
      */
     LabWorkerProcess(const int rank, const int size): WorkerProcess(rank, size),
-      m_stride(getStride(size)),
-      m_aMatrixPart(N * m_stride, 0.),
-      m_xVectorPart(m_stride, 0.),
-      m_dirVector(N, 0.),
-      m_dirVectorPart(m_stride, 0.),
-      m_residualVectorPart(m_stride, 0.),
-      aMatrixMulDirVectorPart(m_stride, 0.)
+      m_rowStarts(getRowStarts(size)),
+      m_stride(m_rowStarts[rank + 1] - m_rowStarts[rank]),
+#ifdef SPARSE_MATRIX
+      m_aSparsePart(makeMatrixRows(m_rowStarts, rank)),
+      m_exchange(m_aSparsePart, m_rowStarts, MPI_COMM_WORLD),
+      m_dirVectorOffset(0),
+#elif defined(BLOCK_2D)
+      m_grid(getGridSide(size)),
+      m_blockSide(N / m_grid.side()),
+      m_partialProduct(m_blockSide, 0.),
+      m_aMatrixPart(m_blockSide * m_blockSide),
+#ifdef MIXED_PRECISION
+      m_aMatrixLowPart(m_aMatrixPart.size()),
+#endif
+      m_dirVectorOffset(0),
+#else
+      m_aMatrixPart(N * m_stride),
+#ifdef MIXED_PRECISION
+      m_aMatrixLowPart(m_aMatrixPart.size()),
+#endif
+      m_dirVectorOffset(m_rowStarts[rank] * RIGHT_HAND_SIDES),
+#endif
+      m_bVectorPart(m_stride * RIGHT_HAND_SIDES, 0.),
+      m_xVectorPart(m_stride * RIGHT_HAND_SIDES, 0.),
+#ifdef SPARSE_MATRIX
+      m_dirVector(m_exchange.extendedSize(), 0.),
+#elif defined(BLOCK_2D)
+      m_dirVector(m_stride + m_blockSide, 0.),
+#else
+      m_dirVector(N * RIGHT_HAND_SIDES, 0.),
+#endif
+      m_residualVectorPart(m_stride * RIGHT_HAND_SIDES, 0.),
+      aMatrixMulDirVectorPart(m_stride * RIGHT_HAND_SIDES, 0.),
+#ifdef PRECONDITIONER
+      m_preconditionedPart(m_stride, 0.),
+#endif
+      m_iterations(0),
+      m_residualNorm(0),
+#ifdef MIXED_PRECISION
+      m_highProductPart(m_stride, 0.),
+      m_solutionPart(m_stride, 0.),
+      m_multiplyLowPart(false),
+      m_refinements(0),
+#endif
+#ifdef PIPELINED_CG
+      m_zVectorPart(m_stride, 0.),
+      m_sVectorPart(m_stride, 0.),
+      m_pVectorPart(m_stride, 0.),
+#endif
+      m_processCpus(getProcessCpus()),
+      m_pool(getThreadsCount(m_processCpus), getThreadsCpus(m_processCpus)),
+      m_threadDots(m_pool.size() * THREAD_DOT_STRIDE, 0.)
     {
+      for(int process = 0; process < size; ++process)
+      {
+        m_vectorCounts.push_back((m_rowStarts[process + 1] - m_rowStarts[process]) * RIGHT_HAND_SIDES);
+        m_vectorOffsets.push_back(m_rowStarts[process] * RIGHT_HAND_SIDES);
+      }
+
+#if defined(BLOCK_2D)
+      //Строки блока делятся между потоками; (p, Ap) считается после сложения частичных произведений
+      m_multiplyTask = [this](const size_t thread, const size_t threadsCount)
+      {
+        size_t begin, end;
+        ThreadPool::split(m_blockSide, thread, threadsCount, GEMV_ROWS, begin, end);
+        gemv(matrixPart() + begin * m_blockSide, m_blockSide, end - begin, m_blockSide,
+             columnBlock(), m_partialProduct.data() + begin);
+      };
+#elif defined(BLOCK_CG)
+      //Строки делятся между потоками; скалярные произведения систем считаются после умножения
+      m_multiplyTask = [this](const size_t thread, const size_t threadsCount)
+      {
+        size_t begin, end;
+        ThreadPool::split(m_stride, thread, threadsCount, GEMV_ROWS, begin, end);
+        gemm<RIGHT_HAND_SIDES>(matrixPart() + begin * N, N, end - begin, N, m_dirVector.data(),
+                               aMatrixMulDirVectorPart.data() + begin * RIGHT_HAND_SIDES);
+      };
+#elif !defined(SPARSE_MATRIX)
+      //Строки делятся между потоками процесса группами по GEMV_ROWS, заодно считается (p, Ap) своих строк
+      m_multiplyTask = [this](const size_t thread, const size_t threadsCount)
+      {
+        size_t begin, end;
+        ThreadPool::split(m_stride, thread, threadsCount, GEMV_ROWS, begin, end);
+        gemv(matrixPart() + begin * N, N, end - begin, N, m_dirVector.data(),
+             aMatrixMulDirVectorPart.data() + begin);
+        m_threadDots[thread * THREAD_DOT_STRIDE] = dot(aMatrixMulDirVectorPart.data() + begin,
+                                                       &m_dirVector[dirVectorIndex(begin)], end - begin);
+      };
+#endif
     }
 
     /*!
@@ -69,20 +519,14 @@ public:
     {
         double calculationTime = MPI_Wtime();
 
-        MPI_Scatter(NULL, m_stride * N, MPI_VALUES_TYPE,
-                    m_aMatrixPart.data(), m_stride * N, MPI_VALUES_TYPE,
-                    0, MPI_COMM_WORLD);
+        generateSystem();
 
-        MPI_Scatter(NULL, m_stride, MPI_VALUES_TYPE,
-                    m_residualVectorPart.data(), m_stride, MPI_VALUES_TYPE,
-                    0, MPI_COMM_WORLD);
+        solve();
 
-        MPI_Bcast(m_dirVector.data(), m_dirVector.size(), MPI_VALUES_TYPE, 0, MPI_COMM_WORLD);
+        checkSolution();
 
-        iterate();
-
-        MPI_Gather(m_xVectorPart.data(), m_stride, MPI_VALUES_TYPE, NULL, m_stride,
-                   MPI_VALUES_TYPE, 0, MPI_COMM_WORLD);
+        MPI_Gatherv(m_xVectorPart.data(), m_stride * RIGHT_HAND_SIDES, MPI_VALUES_TYPE, NULL,
+                    NULL, NULL, MPI_VALUES_TYPE, 0, MPI_COMM_WORLD);
 
         calculationTime = MPI_Wtime() - calculationTime;
         printf("Process %d/%d execution time: %.6f\n", m_rank, m_processesCount, calculationTime);
@@ -93,43 +537,442 @@ protected:
     /*!
      * \brief Решение СЛАУ, метод общий для всех процессов
      */
-    void iterate()
+    void solve()
     {
-      values_t residualDotOld = matrixVectorMul(m_residualVectorPart, m_residualVectorPart)[0];
-      MPI_Allreduce(MPI_IN_PLACE, &residualDotOld, 1, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+#ifdef MIXED_PRECISION
+      refine();
+#elif defined(BLOCK_CG)
+      iterateBlock();
+#else
+      iterate(TOLERANCE);
+#endif
+    }
 
-      size_t iterations = ITERATIONS;
-      while(iterations)
-      {
-        aMatrixMulDirVectorPart = matrixVectorMul(m_aMatrixPart, m_dirVector);
+    /*!
+     * \brief Метод сопряженных градиентов от x = 0 по текущей невязке
+     * (вектор направления уже содержит невязку)
+     * \param tolerance относительное уменьшение невязки, при котором итерации прекращаются
+     */
+    void iterate(const values_t tolerance)
+    {
+#ifdef PIPELINED_CG
+      iteratePipelined(tolerance);
+#else
+#ifdef PRECONDITIONER
+      //Начальное направление - предобусловленная невязка
+      m_preconditioner->apply(m_residualVectorPart.data(), m_preconditionedPart.data());
+      std::copy(m_preconditionedPart.begin(), m_preconditionedPart.end(), m_dirVector.begin() + m_dirVectorOffset);
+      shareDirVector();
+      const values_t* const preconditioned = m_preconditionedPart.data();
+#else
+      const values_t* const preconditioned = m_residualVectorPart.data();
+#endif
 
-        values_t alphaDivisor = matrixVectorMul(aMatrixMulDirVectorPart, m_dirVector.begin() + m_rank * m_stride, m_stride)[0];
+      //(r, M^-1 r) и (r, r) собираются одной редукцией
+      values_t dots[2] = {dot(m_residualVectorPart.data(), preconditioned, m_stride),
+                          dot(m_residualVectorPart.data(), m_residualVectorPart.data(), m_stride)};
+      MPI_Allreduce(MPI_IN_PLACE, dots, 2, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+
+      values_t residualDotOld = dots[0];
+      const values_t bNorm = std::sqrt(dots[1]);
+      m_residualNorm = bNorm;
+      m_iterations = 0;
+
+      //Все рабочие векторы выделены заранее: итерация не обращается к куче
+      while(m_iterations < ITERATIONS && m_residualNorm > tolerance * bNorm)
+      {
+        values_t alphaDivisor = multiplyDirVector();
         MPI_Allreduce(MPI_IN_PLACE, &alphaDivisor, 1, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
 
         const values_t alpha = residualDotOld / alphaDivisor;
 
-        for(size_t index = 0; index < static_cast<size_t>(m_stride); ++index)
+        dots[1] = cgStep(alpha, &m_dirVector[dirVectorIndex(0)], aMatrixMulDirVectorPart.data(),
+                         m_xVectorPart.data(), m_residualVectorPart.data(), m_stride);
+#ifdef PRECONDITIONER
+        m_preconditioner->apply(m_residualVectorPart.data(), m_preconditionedPart.data());
+        dots[0] = dot(m_residualVectorPart.data(), preconditioned, m_stride);
+#else
+        dots[0] = dots[1];
+#endif
+        MPI_Allreduce(MPI_IN_PLACE, dots, 2, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+
+        m_residualNorm = std::sqrt(dots[1]);
+        ++m_iterations;
+
+        const values_t betta = dots[0] / residualDotOld;
+        residualDotOld = dots[0];
+
+        xpay(preconditioned, betta, &m_dirVector[dirVectorIndex(0)], m_stride);
+
+        shareDirVector();
+      }
+      m_residualNorm /= bNorm;
+#endif
+    }
+
+#ifdef BLOCK_CG
+    /*!
+     * \brief Метод сопряженных градиентов для RIGHT_HAND_SIDES систем сразу: у каждой системы свои alpha и betta,
+     * матрица умножается на все векторы направления за один проход, скалярные произведения всех систем
+     * собираются одной редукцией. Сошедшаяся система получает alpha = 0 и дальше не меняется.
+     */
+    void iterateBlock()
+    {
+      values_t residualDots[RIGHT_HAND_SIDES], alphaDivisors[RIGHT_HAND_SIDES];
+      values_t alpha[RIGHT_HAND_SIDES], betta[RIGHT_HAND_SIDES], bNorms[RIGHT_HAND_SIDES];
+
+      blockDot<RIGHT_HAND_SIDES>(m_residualVectorPart.data(), m_residualVectorPart.data(), m_stride, residualDots);
+      MPI_Allreduce(MPI_IN_PLACE, residualDots, RIGHT_HAND_SIDES, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+      for(size_t system = 0; system < RIGHT_HAND_SIDES; ++system)
+        bNorms[system] = std::sqrt(residualDots[system]);
+
+      auto converged = [&](const size_t system)
+      {
+        return std::sqrt(residualDots[system]) <= TOLERANCE * bNorms[system];
+      };
+
+      for(m_iterations = 0; m_iterations < ITERATIONS; ++m_iterations)
+      {
+        size_t active = 0;
+        for(size_t system = 0; system < RIGHT_HAND_SIDES; ++system)
+          active += !converged(system);
+        if(!active)
+          break;
+
+        multiplyDirVector();
+        blockDot<RIGHT_HAND_SIDES>(aMatrixMulDirVectorPart.data(), &m_dirVector[dirVectorIndex(0)], m_stride,
+                                   alphaDivisors);
+        MPI_Allreduce(MPI_IN_PLACE, alphaDivisors, RIGHT_HAND_SIDES, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+
+        for(size_t system = 0; system < RIGHT_HAND_SIDES; ++system)
+          alpha[system] = converged(system) ? 0 : residualDots[system] / alphaDivisors[system];
+
+        values_t newResidualDots[RIGHT_HAND_SIDES];
+        blockCgStep<RIGHT_HAND_SIDES>(alpha, &m_dirVector[dirVectorIndex(0)], aMatrixMulDirVectorPart.data(),
+                                      m_xVectorPart.data(), m_residualVectorPart.data(), m_stride, newResidualDots);
+        MPI_Allreduce(MPI_IN_PLACE, newResidualDots, RIGHT_HAND_SIDES, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+
+        for(size_t system = 0; system < RIGHT_HAND_SIDES; ++system)
         {
-          m_xVectorPart[index] = m_xVectorPart[index] + alpha * m_dirVector[globalVectorIndex(index)];
-          m_residualVectorPart[index] = m_residualVectorPart[index] - alpha * aMatrixMulDirVectorPart[index];
+          betta[system] = converged(system) ? 0 : newResidualDots[system] / residualDots[system];
+          if(!converged(system))
+            residualDots[system] = newResidualDots[system];
         }
 
-        values_t residualDotNew = matrixVectorMul(m_residualVectorPart, m_residualVectorPart)[0];
-        MPI_Allreduce(MPI_IN_PLACE, &residualDotNew, 1, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+        blockXpay<RIGHT_HAND_SIDES>(m_residualVectorPart.data(), betta, &m_dirVector[dirVectorIndex(0)], m_stride);
+        shareDirVector();
+      }
+
+      //Худшая из систем
+      m_residualNorm = 0;
+      for(size_t system = 0; system < RIGHT_HAND_SIDES; ++system)
+        m_residualNorm = std::max(m_residualNorm, std::sqrt(residualDots[system]) / bNorms[system]);
+    }
+#endif
+
+#ifdef PIPELINED_CG
+    /*!
+     * \brief Конвейерный вариант (Ghysels, Vanroose): w = A r и z = A s обновляются рекуррентно,
+     * поэтому оба скалярных произведения итерации известны до умножения и собираются
+     * одной MPI_Iallreduce, которая идет одновременно с обменом w и умножением q = A w.
+     * Вектор направления (m_dirVector) хранит w, своя часть направления - m_pVectorPart.
+     */
+    void iteratePipelined(const values_t tolerance)
+    {
+      values_t* const wVectorPart = &m_dirVector[dirVectorIndex(0)];
+
+      //w = A r (x = 0, r = B уже лежит в векторе направления)
+      multiplyDirVector();
+      std::copy(aMatrixMulDirVectorPart.begin(), aMatrixMulDirVectorPart.end(), wVectorPart);
+
+      values_t dots[2] = {dot(m_residualVectorPart.data(), m_residualVectorPart.data(), m_stride),
+                          dot(wVectorPart, m_residualVectorPart.data(), m_stride)};
+      values_t gammaOld = 0, alphaOld = 0, bNorm = 0;
+
+      for(m_iterations = 0; m_iterations < ITERATIONS; ++m_iterations)
+      {
+        MPI_Request request;
+        MPI_Iallreduce(MPI_IN_PLACE, dots, 2, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD, &request);
+
+        shareDirVector();
+        multiplyDirVector();
+
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+        const values_t gamma = dots[0];
+        const values_t delta = dots[1];
 
-        const values_t betta = residualDotNew / residualDotOld;
-        residualDotOld = residualDotNew;
+        //Невязка известна только после редукции, поэтому умножение на последней итерации лишнее
+        m_residualNorm = std::sqrt(gamma);
+        if(!m_iterations)
+          bNorm = m_residualNorm;
+        if(m_residualNorm <= tolerance * bNorm)
+          break;
 
+        const values_t betta = m_iterations ? gamma / gammaOld : 0;
+        const values_t alpha = m_iterations ? gamma / (delta - betta * gamma / alphaOld) : gamma / delta;
+        gammaOld = gamma;
+        alphaOld = alpha;
+
+        pipelinedCgStep(alpha, betta, aMatrixMulDirVectorPart.data(), m_zVectorPart.data(), m_sVectorPart.data(),
+                        m_pVectorPart.data(), m_xVectorPart.data(), m_residualVectorPart.data(), wVectorPart,
+                        m_stride, dots[0], dots[1]);
+      }
+      m_residualNorm /= bNorm;
+    }
+#endif
+
+    /*!
+     * \brief aMatrixMulDirVectorPart = часть A x вектор направления
+     * \return Часть скалярного произведения (вектор направления, aMatrixMulDirVectorPart) по своим строкам
+     */
+    values_t multiplyDirVector()
+    {
+#ifdef SPARSE_MATRIX
+      m_aSparsePart.multiply(m_dirVector.data(), aMatrixMulDirVectorPart.data());
+      return dot(aMatrixMulDirVectorPart.data(), &m_dirVector[dirVectorIndex(0)], m_stride);
+#elif defined(BLOCK_2D)
+      m_pool.run(m_multiplyTask);
+      m_grid.reduceRowBlock(m_partialProduct.data(), m_stride, aMatrixMulDirVectorPart.data());
+      return dot(aMatrixMulDirVectorPart.data(), &m_dirVector[dirVectorIndex(0)], m_stride);
+#else
+      m_pool.run(m_multiplyTask);
+
+      values_t result = 0;
+      for(size_t thread = 0; thread < m_pool.size(); ++thread)
+        result += m_threadDots[thread * THREAD_DOT_STRIDE];
+      return result;
+#endif
+    }
+
+    /*!
+     * \brief Рассылает обновленную часть вектора направления процессам, которым она нужна
+     */
+    void shareDirVector()
+    {
+#ifdef SPARSE_MATRIX
+      m_exchange.exchange(m_dirVector.data());
+#elif defined(BLOCK_2D)
+      m_grid.gatherColumnBlock(&m_dirVector[dirVectorIndex(0)], m_stride, columnBlock());
+#else
+      MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, m_dirVector.data(), m_vectorCounts.data(),
+                     m_vectorOffsets.data(), MPI_VALUES_TYPE, MPI_COMM_WORLD);
+#endif
+    }
+
+#ifdef BLOCK_2D
+    /*!
+     * \brief Полоса вектора направления, соответствующая полосе столбцов блока матрицы
+     * (лежит в m_dirVector за своей частью)
+     */
+    values_t* columnBlock()
+    {
+      return m_dirVector.data() + m_stride;
+    }
+#endif
+
+#ifndef SPARSE_MATRIX
+    void setMatrixValue(const size_t index, const values_t value)
+    {
+      m_aMatrixPart[index] = static_cast<matrix_values_t>(value);
+#ifdef MIXED_PRECISION
+      //Старшая и младшая части вместе дают 48 бит мантиссы
+      m_aMatrixLowPart[index] = static_cast<float>(value - m_aMatrixPart[index]);
+#endif
+    }
+
+    /*!
+     * \brief Матрица, которую умножает задача потоков
+     */
+    const matrix_values_t* matrixPart() const
+    {
+#ifdef MIXED_PRECISION
+      if(m_multiplyLowPart)
+        return m_aMatrixLowPart.data();
+#endif
+      return m_aMatrixPart.data();
+    }
+#endif
+
+    /*!
+     * \brief aMatrixMulDirVectorPart = A x вектор направления с полной точностью
+     */
+    void multiplyDirVectorExact()
+    {
+#ifdef MIXED_PRECISION
+      multiplyDirVector();
+      std::copy(aMatrixMulDirVectorPart.begin(), aMatrixMulDirVectorPart.end(), m_highProductPart.begin());
+      m_multiplyLowPart = true;
+      multiplyDirVector();
+      m_multiplyLowPart = false;
+      axpy(values_t(1), m_highProductPart.data(), aMatrixMulDirVectorPart.data(), m_stride);
+#else
+      multiplyDirVector();
+#endif
+    }
+
+#ifdef MIXED_PRECISION
+    /*!
+     * \brief Итерационное уточнение. Поправка d из A_high d = r ищется методом сопряженных градиентов
+     * по старшим частям матрицы до INNER_TOLERANCE, невязка r = B - A x считается по полной матрице.
+     */
+    void refine()
+    {
+      values_t bNorm = dot(m_bVectorPart.data(), m_bVectorPart.data(), m_stride);
+      MPI_Allreduce(MPI_IN_PLACE, &bNorm, 1, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+      bNorm = std::sqrt(bNorm);
+
+      size_t iterations = 0;
+      values_t residualNorm = 1;
+      //x = 0: невязка равна B и уже лежит в векторе направления
+      for(m_refinements = 0; m_refinements < REFINEMENT_STEPS && residualNorm > TOLERANCE; ++m_refinements)
+      {
+        std::fill(m_xVectorPart.begin(), m_xVectorPart.end(), 0.);
+        iterate(INNER_TOLERANCE);
+        iterations += m_iterations;
+        axpy(values_t(1), m_xVectorPart.data(), m_solutionPart.data(), m_stride);
+
+        std::copy(m_solutionPart.begin(), m_solutionPart.end(), m_dirVector.begin() + m_dirVectorOffset);
+        shareDirVector();
+        multiplyDirVectorExact();
         for(size_t index = 0; index < static_cast<size_t>(m_stride); ++index)
+          m_residualVectorPart[index] = m_bVectorPart[index] - aMatrixMulDirVectorPart[index];
+
+        residualNorm = dot(m_residualVectorPart.data(), m_residualVectorPart.data(), m_stride);
+        MPI_Allreduce(MPI_IN_PLACE, &residualNorm, 1, MPI_VALUES_TYPE, MPI_SUM, MPI_COMM_WORLD);
+        residualNorm = std::sqrt(residualNorm) / bNorm;
+
+        std::copy(m_residualVectorPart.begin(), m_residualVectorPart.end(), m_dirVector.begin() + m_dirVectorOffset);
+        shareDirVector();
+      }
+
+      m_xVectorPart = m_solutionPart;
+      m_iterations = iterations;
+      m_residualNorm = residualNorm;
+    }
+#endif
+
+    /*!
+     * \brief Каждый процесс сам строит свои строки матрицы A и свою часть вектора B.
+     * Начальное приближение x = 0: невязка и направление равны B.
+     */
+    void generateSystem()
+    {
+#ifndef SPARSE_MATRIX
+#ifdef MATRIX_FILE
+      const CsrMatrix loadedRows = makeMatrixRows(m_rowStarts, m_rank);
+#endif
+#ifdef BLOCK_2D
+      const size_t rowsCount = m_blockSide;
+#else
+      const size_t rowsCount = m_stride;
+#endif
+
+      //Строки делятся между потоками так же, как при умножении, и заполняются подряд, как лежат в памяти:
+      //страницы строк выделяются (первое касание) на узле NUMA потока, который их потом читает
+      m_pool.run([&](const size_t thread, const size_t threadsCount)
+      {
+        size_t begin, end;
+        ThreadPool::split(rowsCount, thread, threadsCount, GEMV_ROWS, begin, end);
+        for(size_t row = begin; row < end; ++row)
         {
-          m_dirVector[globalVectorIndex(index)] = m_residualVectorPart[index] + betta * m_dirVector[globalVectorIndex(index)];
+#if defined(BLOCK_2D)
+          for(size_t column = 0; column < m_blockSide; ++column)
+            setMatrixValue(row * m_blockSide + column, aMatrixValue(m_grid.row() * m_blockSide + row,
+                                                                    m_grid.column() * m_blockSide + column));
+#elif defined(MATRIX_FILE)
+          for(size_t column = 0; column < N; ++column)
+            setMatrixValue(row * N + column, 0);
+          for(size_t index = loadedRows.m_rowOffsets[row]; index < loadedRows.m_rowOffsets[row + 1]; ++index)
+            setMatrixValue(row * N + loadedRows.m_columns[index], loadedRows.m_values[index]);
+#else
+          for(size_t column = 0; column < N; ++column)
+            setMatrixValue(row * N + column, aMatrixValue(globalVectorIndex(row), column));
+#endif
         }
+      });
+#endif
+
+      //При BLOCK_CG правые части лежат вперемешку: элемент row системы j - в row * RIGHT_HAND_SIDES + j
+      for(size_t index = 0; index < m_bVectorPart.size(); ++index)
+        m_bVectorPart[index] = bVectorValue(globalVectorIndex(index / RIGHT_HAND_SIDES), index % RIGHT_HAND_SIDES);
 
-        MPI_Allgather(MPI_IN_PLACE, m_stride, MPI_VALUES_TYPE, m_dirVector.data(), m_stride,
-                      MPI_VALUES_TYPE, MPI_COMM_WORLD);
+      m_residualVectorPart = m_bVectorPart;
+      std::copy(m_residualVectorPart.begin(), m_residualVectorPart.end(), m_dirVector.begin() + m_dirVectorOffset);
+      shareDirVector();
 
-        --iterations;
+#ifdef PRECONDITIONER
+      m_preconditioner = makePreconditioner();
+#endif
+    }
+
+#ifdef PRECONDITIONER
+    /*!
+     * \brief Строит выбранный предобуславливатель по своим строкам матрицы
+     */
+    std::unique_ptr<Preconditioner> makePreconditioner() const
+    {
+#if PRECONDITIONER == PRECONDITIONER_JACOBI
+      std::vector<values_t> diagonal(m_stride);
+      for(size_t row = 0; row < static_cast<size_t>(m_stride); ++row)
+      {
+#ifdef SPARSE_MATRIX
+        //Столбцы своих строк уже переведены в локальные индексы
+        for(size_t index = m_aSparsePart.m_rowOffsets[row]; index < m_aSparsePart.m_rowOffsets[row + 1]; ++index)
+          if(m_aSparsePart.m_columns[index] == row)
+            diagonal[row] = m_aSparsePart.m_values[index];
+#else
+        diagonal[row] = m_aMatrixPart[row * N + globalVectorIndex(row)];
+#endif
       }
+      return std::unique_ptr<Preconditioner>(new JacobiPreconditioner(diagonal));
+#elif PRECONDITIONER == PRECONDITIONER_BLOCK_JACOBI
+#ifdef SPARSE_MATRIX
+      return std::unique_ptr<Preconditioner>(new IncompleteCholeskyPreconditioner(m_aSparsePart, m_stride));
+#else
+      std::vector<values_t> block(static_cast<size_t>(m_stride) * m_stride);
+      for(size_t row = 0; row < static_cast<size_t>(m_stride); ++row)
+        std::copy_n(&m_aMatrixPart[row * N + globalVectorIndex(0)], m_stride, &block[row * m_stride]);
+      return std::unique_ptr<Preconditioner>(new CholeskyPreconditioner(std::move(block), m_stride));
+#endif
+#else
+#error "Unknown PRECONDITIONER"
+#endif
+    }
+#endif
+
+    /*!
+     * \brief Проверка решения на распределенной матрице: нормы истинной невязки B - A x каждой системы
+     * собираются на главном процессе одной редукцией (вектор направления используется как буфер)
+     * \return Нормы невязки каждой системы (только на главном процессе)
+     */
+    std::vector<ResidualNorms> checkSolution()
+    {
+      std::copy(m_xVectorPart.begin(), m_xVectorPart.end(), m_dirVector.begin() + m_dirVectorOffset);
+      shareDirVector();
+      multiplyDirVectorExact();
+
+      std::vector<ResidualNorms> norms(RIGHT_HAND_SIDES, ResidualNorms{0, 0, 0});
+      for(size_t index = 0; index < m_bVectorPart.size(); ++index)
+      {
+        const double delta = m_bVectorPart[index] - aMatrixMulDirVectorPart[index];
+        ResidualNorms& systemNorms = norms[index % RIGHT_HAND_SIDES];
+        systemNorms.m_squares += delta * delta;
+        systemNorms.m_bSquares += static_cast<double>(m_bVectorPart[index]) * m_bVectorPart[index];
+        systemNorms.m_max = std::max(systemNorms.m_max, std::abs(delta));
+      }
+
+      MPI_Datatype normsType;
+      MPI_Type_contiguous(3, MPI_DOUBLE, &normsType);
+      MPI_Type_commit(&normsType);
+      MPI_Op normsOp;
+      MPI_Op_create(reduceResidualNorms, 1, &normsOp);
+
+      MPI_Reduce(m_rank ? norms.data() : MPI_IN_PLACE, norms.data(), RIGHT_HAND_SIDES, normsType, normsOp, 0,
+                 MPI_COMM_WORLD);
+
+      MPI_Op_free(&normsOp);
+      MPI_Type_free(&normsType);
+      return norms;
     }
 
     /*!
@@ -153,63 +996,71 @@ protected:
     }
 
     /*!
-     * \brief Умножение матрицы на вектор (можно и 2 вектора перемножать)
-     * \param matrix
-     * \param vector
-     * \return Результирующий вектор
-     */
-    std::vector<values_t> matrixVectorMul(const std::vector<values_t>& matrix, const std::vector<values_t>& vector)
-    {
-      std::vector<values_t> result;
-      for(size_t row = 0; row < matrix.size() / vector.size(); ++row)
-      {
-        double value = 0;
-        for(size_t column = 0; column < vector.size(); ++column)
-          value += matrix[row * vector.size() + column] * vector[column];
-        result.push_back(value);
-      }
-      return result;
-    }
-
-    /*!
-     * \brief Умножение матрицы на вектор заданный итератором на начало и размером (можно и 2 вектора перемножать)
-     * \param matrix
-     * \param vectorIterator Итератор начала вектора
-     * \param vectorSize Размер вектора
-     * \return Результирующий вектор
+     * \brief Получение индекса элемента в общем векторе по локальному индексу части вектора в процессе
+     * \param localVectorIndex Локальный индекс
+     * \return Индекс в целом векторе
      */
-    template <typename I>
-    std::vector<values_t> matrixVectorMul(const std::vector<values_t>& matrix, const I& vectorIterator, const size_t vectorSize)
+    size_t globalVectorIndex(const size_t localVectorIndex) const
     {
-      std::vector<values_t> result;
-      for(size_t row = 0; row < matrix.size() / vectorSize; ++row)
-      {
-        double value = 0;
-        I iterator = vectorIterator;
-        for(size_t column = 0; column < vectorSize; ++column)
-          value += matrix[row * vectorSize + column] * (*(iterator++));
-        result.push_back(value);
-      }
-      return result;
+      return m_rowStarts[m_rank] + localVectorIndex;
     }
 
     /*!
-     * \brief Получение индекса элемента в общем векторе по локальному индексу части вектора в процессе
+     * \brief Получение индекса элемента в векторе направления по локальному индексу части вектора в процессе
      * \param localVectorIndex Локальный индекс
-     * \return Индекс в целом векторе
+     * \return Индекс в m_dirVector
      */
-    const size_t globalVectorIndex(const size_t localVectorIndex) const
+    size_t dirVectorIndex(const size_t localVectorIndex) const
     {
-      return m_rank * m_stride + localVectorIndex;
+      return m_dirVectorOffset + localVectorIndex;
     }
 
-    const int m_stride;//!< Количество строк матрицы на 1 процесс
-    std::vector<values_t> m_aMatrixPart;//!< Часть матрицы А
+    const std::vector<size_t> m_rowStarts;//!< Первая строка каждого процесса
+    const int m_stride;//!< Количество строк матрицы процесса
+    std::vector<int> m_vectorCounts;//!< Размеры частей векторов процессов (m_stride * RIGHT_HAND_SIDES)
+    std::vector<int> m_vectorOffsets;//!< Начала частей векторов процессов
+#ifdef SPARSE_MATRIX
+    CsrMatrix m_aSparsePart;//!< Строки матрицы А (столбцы - индексы m_dirVector)
+    GhostExchange m_exchange;//!< План обмена частями вектора направления
+#else
+#ifdef BLOCK_2D
+    ProcessGrid m_grid;//!< Решетка процессов
+    const size_t m_blockSide;//!< Сторона блока матрицы
+    std::vector<values_t> m_partialProduct;//!< Произведение блока на полосу вектора направления
+#endif
+    //Память матрицы не инициализируется при создании: ее заполняют потоки пула (generateSystem)
+    std::vector<matrix_values_t, FirstTouchAllocator<matrix_values_t>> m_aMatrixPart;//!< Часть матрицы А
+#ifdef MIXED_PRECISION
+    std::vector<float, FirstTouchAllocator<float>> m_aMatrixLowPart;//!< Младшие части значений матрицы А (A - m_aMatrixPart)
+#endif
+#endif
+    const size_t m_dirVectorOffset;//!< Начало своей части в m_dirVector
+    std::vector<values_t> m_bVectorPart;//!< Часть вектора B
     std::vector<values_t> m_xVectorPart;//!< Часть вектора результатов
     std::vector<values_t> m_dirVector;//!< Вектор направления
-    std::vector<values_t> m_dirVectorPart;//!< Часть вектора направления
     std::vector<values_t> m_residualVectorPart;//!< Часть вектора невязки
     std::vector<values_t> aMatrixMulDirVectorPart;//!< Результат aMatrixPart x dirVector
+#ifdef PRECONDITIONER
+    std::unique_ptr<Preconditioner> m_preconditioner;
+    std::vector<values_t> m_preconditionedPart;//!< Часть предобусловленной невязки M^-1 r
+#endif
+    size_t m_iterations;//!< Выполнено итераций
+    values_t m_residualNorm;//!< Относительная невязка |r| / |B| по рекуррентной невязке
+#ifdef MIXED_PRECISION
+    std::vector<values_t> m_highProductPart;//!< Произведение старших частей матрицы на вектор направления
+    std::vector<values_t> m_solutionPart;//!< Часть уточняемого решения
+    bool m_multiplyLowPart;//!< Задача потоков умножает младшие части матрицы
+    size_t m_refinements;//!< Выполнено шагов уточнения
+#endif
+#ifdef PIPELINED_CG
+    std::vector<values_t> m_zVectorPart;//!< Часть z = A s
+    std::vector<values_t> m_sVectorPart;//!< Часть s = A p
+    std::vector<values_t> m_pVectorPart;//!< Часть вектора направления
+#endif
+    const std::vector<int> m_processCpus;//!< Свои процессоры процесса на узле
+    ThreadPool m_pool;//!< Потоки для умножения матрицы на вектор
+    std::vector<values_t> m_threadDots;//!< Частичные скалярные произведения потоков (через строку кэша)
+    std::function<void(size_t, size_t)> m_multiplyTask;//!< Задача потоков умножения (создается один раз)
 
 }; // end of LabWorkerProcess
 
@@ -225,104 +1076,38 @@ public:
      */
     LabMainProcess(const int size):
         LabWorkerProcess(0u, size),
-        m_aMatrix(N * N, 0.),
-        m_bVector(N, 0.),
-        m_residualVector(N, 0.),
-        m_xVector(N, 0.)
+        m_xVector(N * RIGHT_HAND_SIDES, 0.)
     {
-      randomizeAMatrix();
-      randomizeBVector();
     }
 
     virtual void execute()
     {
         double mainTime = MPI_Wtime();
 
-        MPI_Scatter(m_aMatrix.data(), m_stride * N, MPI_VALUES_TYPE,
-                    m_aMatrixPart.data(), m_stride * N, MPI_VALUES_TYPE,
-                    0, MPI_COMM_WORLD);
-
-        //m_xVector = 0
-        m_residualVector = m_bVector;
-        m_dirVector = m_residualVector;
-
-        MPI_Scatter(m_residualVector.data(), m_stride, MPI_VALUES_TYPE,
-                    m_residualVectorPart.data(), m_stride, MPI_VALUES_TYPE,
-                    0, MPI_COMM_WORLD);
+        generateSystem();
 
-        MPI_Bcast(m_dirVector.data(), m_dirVector.size(), MPI_VALUES_TYPE, 0, MPI_COMM_WORLD);
+        solve();
 
-        iterate();
+        const std::vector<ResidualNorms> norms = checkSolution();
+        printf("Iterations: %zu, relative residual: %.3e\n", m_iterations, m_residualNorm);
+#ifdef MIXED_PRECISION
+        printf("Refinement steps: %zu\n", m_refinements);
+#endif
 
-        MPI_Gather(m_xVectorPart.data(), m_stride, MPI_VALUES_TYPE, m_xVector.data(), m_stride,
-                   MPI_VALUES_TYPE, 0, MPI_COMM_WORLD);
+        MPI_Gatherv(m_xVectorPart.data(), m_stride * RIGHT_HAND_SIDES, MPI_VALUES_TYPE, m_xVector.data(),
+                    m_vectorCounts.data(), m_vectorOffsets.data(), MPI_VALUES_TYPE, 0, MPI_COMM_WORLD);
 
         mainTime = MPI_Wtime() - mainTime;
         printf("Main process %d/%d execution time: %.6f\n", m_rank, m_processesCount, mainTime);
 
-        double check = 0;
-        const std::vector<values_t>& multVector = matrixVectorMul(m_aMatrix, m_xVector);
-        for(size_t index = 0; index < N; ++index)
-          check += m_bVector[index] - multVector[index];
-
         std::cout << "RESULT:" << std::endl;
         //printMatrix(m_xVector);
-        std::cout << "Check delta sum: " << check << std::endl;
+        for(size_t system = 0; system < norms.size(); ++system)
+          printf("|B - Ax|: %.6e, relative: %.3e, max |B - Ax|: %.6e\n", std::sqrt(norms[system].m_squares),
+                 std::sqrt(norms[system].m_squares / norms[system].m_bSquares), norms[system].m_max);
     }
 
 private:
-    /*!
-     * \brief Заполняет матрицу А случайными значениями (так чтобы матрица была симметрична)
-     */
-    void randomizeAMatrix()
-    {
-      srand(time(0));
-
-      for(int row = 0; row < N; ++row)
-        for(int column = N - 1; column >= 0; --column)
-        {
-          if(column >= row)
-            aValue(column, row) = rand() % 10;
-          else
-            aValue(column, row) = aValue(row, column);
-        }
-    }
-
-    /*!
-     * \brief Заполняет вектор B случайными значениями
-     */
-    void randomizeBVector()
-    {
-      srand(time(0));
-      for(auto& value : m_bVector)
-        value = rand() % 10;
-    }
-
-    /*!
-     * \brief Доступ к элементам матрицы A
-     * \param column
-     * \param row
-     * \return
-     */
-    values_t& aValue(size_t column, size_t row)
-    {
-      return m_aMatrix[row * N + column];
-    }
-
-    /*!
-     * \brief Константный доступ к элементам матрицы A
-     * \param column
-     * \param row
-     * \return
-     */
-    const values_t aValue(size_t column, size_t row) const
-    {
-      return m_aMatrix[row * N + column];
-    }
-
-    std::vector<values_t> m_aMatrix;//!< Матрица A
-    std::vector<values_t> m_bVector;//!< Вектор B
-    std::vector<values_t> m_residualVector;//!< Вектор невязки
     std::vector<values_t> m_xVector;//!< Вектор результата
 
 }; // end of MainProcess
@@ -354,6 +1139,7 @@ int main(int argc, char *argv[])
 
     std::unique_ptr<Process> process = makeProcess(rank, size);
     process->execute();
+    process.reset(); //Коммуникаторы процесса освобождаются до завершения MPI
 
     MPI_Finalize(); /* ends MPI */
     return 0;
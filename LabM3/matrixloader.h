@@ -0,0 +1,335 @@
+#ifndef MATRIXLOADER_H
+#define MATRIXLOADER_H
+
+#include "lab3types.h"
+#include "sparsematrix.h"
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Собственный двоичный формат матрицы (все числа - uint64_t в порядке байт машины, если не указано иное):
+ *   заголовок MatrixFileHeader;
+ *   m_rows + 1 смещений начала строк (как CsrMatrix::m_rowOffsets всей матрицы);
+ *   m_nonZeros номеров столбцов;
+ *   m_nonZeros значений типа values_t.
+ * Начало каждого раздела выровнено на MATRIX_FILE_ALIGNMENT, поэтому файл можно отобразить в память
+ * и пользоваться разделами как массивами. Процесс читает только смещения своих строк и их диапазон
+ * столбцов и значений - без разбора и без обмена.
+ */
+
+const char MATRIX_FILE_MAGIC[8] = {'L', 'A', 'B', 'M', 'C', 'S', 'R', '\0'};
+const uint32_t MATRIX_FILE_VERSION = 1u;
+const uint64_t MATRIX_FILE_ALIGNMENT = 64u;//!< Выравнивание разделов (строка кэша)
+const uint64_t MATRIX_MARKET_LINE_LIMIT = 256u;//!< Наибольшая длина строки элемента Matrix Market
+
+/*!
+ * \brief Заголовок двоичного файла матрицы
+ */
+struct MatrixFileHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_valueSize;//!< sizeof(values_t)
+    uint64_t m_rows;
+    uint64_t m_columns;
+    uint64_t m_nonZeros;
+    uint64_t m_rowOffsetsOffset;//!< Смещения разделов от начала файла
+    uint64_t m_columnsOffset;
+    uint64_t m_valuesOffset;
+};
+
+inline uint64_t matrixFileAligned(const uint64_t offset)
+{
+    return (offset + MATRIX_FILE_ALIGNMENT - 1) / MATRIX_FILE_ALIGNMENT * MATRIX_FILE_ALIGNMENT;
+}
+
+/*!
+ * \brief Элемент матрицы при разборе Matrix Market
+ */
+struct MatrixEntry
+{
+    uint64_t m_row;
+    uint64_t m_column;
+    values_t m_value;
+
+    bool operator<(const MatrixEntry& other) const
+    {
+        return m_row < other.m_row || (m_row == other.m_row && m_column < other.m_column);
+    }
+};
+
+inline int rowOwner(const std::vector<size_t>& rowStarts, const uint64_t row)
+{
+    return std::upper_bound(rowStarts.begin(), rowStarts.end(), row) - rowStarts.begin() - 1;
+}
+
+/*!
+ * \brief Читает строки процесса из двоичного файла (коллективная операция)
+ */
+inline CsrMatrix loadNativeMatrixRows(MPI_File file, const MatrixFileHeader& header,
+                                      const std::vector<size_t>& rowStarts, const int rank)
+{
+    const size_t firstRow = rowStarts[rank];
+    const size_t rowsCount = rowStarts[rank + 1] - firstRow;
+
+    std::vector<uint64_t> offsets(rowsCount + 1);
+    MPI_File_read_at_all(file, header.m_rowOffsetsOffset + firstRow * sizeof(uint64_t), offsets.data(),
+                         offsets.size(), MPI_UINT64_T, MPI_STATUS_IGNORE);
+
+    CsrMatrix matrix;
+    const uint64_t first = offsets.front();
+    const size_t nonZeros = offsets.back() - first;
+    std::vector<uint64_t> columns(nonZeros);
+    matrix.m_values.resize(nonZeros);
+    MPI_File_read_at_all(file, header.m_columnsOffset + first * sizeof(uint64_t), columns.data(), nonZeros,
+                         MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_File_read_at_all(file, header.m_valuesOffset + first * sizeof(values_t), matrix.m_values.data(), nonZeros,
+                         MPI_VALUES_TYPE, MPI_STATUS_IGNORE);
+
+    matrix.m_columns.assign(columns.begin(), columns.end());
+    matrix.m_rowOffsets.resize(rowsCount + 1);
+    for(size_t row = 0; row <= rowsCount; ++row)
+        matrix.m_rowOffsets[row] = offsets[row] - first;
+    return matrix;
+}
+
+/*!
+ * \brief Читает строки процесса из файла Matrix Market (coordinate real/integer, general/symmetric).
+ * Заголовок разбирает главный процесс, область элементов делится между процессами поровну по байтам:
+ * строка файла принадлежит процессу, в чьей доле лежит ее начало. Разобранные элементы (и отражения
+ * элементов симметричной матрицы) отправляются владельцам строк одним MPI_Alltoallv.
+ */
+inline CsrMatrix loadMatrixMarketRows(MPI_File file, const std::string& path, const std::vector<size_t>& rowStarts,
+                                      const int rank, const int processesCount)
+{
+    //Заголовок: смещение первого элемента, симметричность, размеры
+    uint64_t info[5] = {0, 0, 0, 0, 0};
+    if(!rank)
+    {
+        std::ifstream is(path);
+        std::string line;
+        std::getline(is, line);
+        std::istringstream banner(line);
+        std::string tag, object, format, field, symmetry;
+        banner >> tag >> object >> format >> field >> symmetry;
+        for(std::string* word : {&format, &field, &symmetry})
+            std::transform(word->begin(), word->end(), word->begin(), ::tolower);
+
+        if(tag == "%%MatrixMarket" && object == "matrix" && format == "coordinate" &&
+           (field == "real" || field == "integer" || field == "double") &&
+           (symmetry == "general" || symmetry == "symmetric"))
+        {
+            while(std::getline(is, line) && (line.empty() || line[0] == '%'))
+                ;
+            std::istringstream sizes(line);
+            if(sizes >> info[2] >> info[3] >> info[4])
+            {
+                info[0] = static_cast<uint64_t>(is.tellg());
+                info[1] = symmetry == "symmetric";
+            }
+        }
+    }
+    MPI_Bcast(info, 5, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    if(!info[0])
+        throw std::runtime_error("Unsupported Matrix Market file " + path);
+    if(info[2] != rowStarts.back() || info[3] != rowStarts.back())
+        throw std::runtime_error("Matrix size in " + path + " does not match the system size");
+
+    MPI_Offset fileSize;
+    MPI_File_get_size(file, &fileSize);
+    const uint64_t dataSize = fileSize - info[0];
+    const uint64_t begin = info[0] + dataSize * rank / processesCount;
+    const uint64_t end = info[0] + dataSize * (rank + 1) / processesCount;
+
+    //Байт перед долей показывает, начинается ли в ней строка; за долей дочитывается конец последней строки
+    const uint64_t readBegin = begin > info[0] ? begin - 1 : begin;
+    const uint64_t readEnd = std::min<uint64_t>(end + MATRIX_MARKET_LINE_LIMIT, fileSize);
+    std::vector<char> text(readEnd - readBegin + 1, '\0');
+    MPI_File_read_at_all(file, readBegin, text.data(), readEnd - readBegin, MPI_CHAR, MPI_STATUS_IGNORE);
+
+    size_t position = 0;
+    if(readBegin < begin)
+    {
+        //Строка, начатая в предыдущей доле, принадлежит ее процессу
+        position = 1;
+        if(text[0] != '\n')
+            while(position < text.size() - 1 && text[position - 1] != '\n')
+                ++position;
+    }
+
+    std::vector<std::vector<MatrixEntry>> outgoing(processesCount);
+    int badEntries = 0;
+    while(position + 1 < text.size() && readBegin + position < end)
+    {
+        const size_t lineEnd = std::find(text.begin() + position, text.end() - 1, '\n') - text.begin();
+        if(text[position] != '%' && text[position] != '\n')
+        {
+            char* cursor = &text[position];
+            MatrixEntry entry;
+            entry.m_row = std::strtoull(cursor, &cursor, 10) - 1;
+            entry.m_column = std::strtoull(cursor, &cursor, 10) - 1;
+            entry.m_value = std::strtod(cursor, &cursor);
+            if(entry.m_row >= info[2] || entry.m_column >= info[3])
+            {
+                ++badEntries;
+                position = lineEnd + 1;
+                continue;
+            }
+
+            outgoing[rowOwner(rowStarts, entry.m_row)].push_back(entry);
+            if(info[1] && entry.m_row != entry.m_column)
+                outgoing[rowOwner(rowStarts, entry.m_column)].push_back({entry.m_column, entry.m_row, entry.m_value});
+        }
+        position = lineEnd + 1;
+    }
+
+    //Ошибку должны увидеть все процессы, иначе остальные зависнут в обмене
+    MPI_Allreduce(MPI_IN_PLACE, &badEntries, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if(badEntries)
+        throw std::runtime_error("Bad Matrix Market entries in " + path);
+
+    std::vector<int> sendCounts(processesCount), receiveCounts(processesCount);
+    std::vector<int> sendOffsets(processesCount, 0), receiveOffsets(processesCount, 0);
+    std::vector<MatrixEntry> sendEntries;
+    for(int process = 0; process < processesCount; ++process)
+    {
+        sendOffsets[process] = sendEntries.size() * sizeof(MatrixEntry);
+        sendCounts[process] = outgoing[process].size() * sizeof(MatrixEntry);
+        sendEntries.insert(sendEntries.end(), outgoing[process].begin(), outgoing[process].end());
+    }
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, receiveCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for(int process = 1; process < processesCount; ++process)
+        receiveOffsets[process] = receiveOffsets[process - 1] + receiveCounts[process - 1];
+
+    std::vector<MatrixEntry> entries((receiveOffsets.back() + receiveCounts.back()) / sizeof(MatrixEntry));
+    MPI_Alltoallv(sendEntries.data(), sendCounts.data(), sendOffsets.data(), MPI_BYTE,
+                  entries.data(), receiveCounts.data(), receiveOffsets.data(), MPI_BYTE, MPI_COMM_WORLD);
+    std::sort(entries.begin(), entries.end());
+
+    CsrMatrix matrix;
+    matrix.m_columns.reserve(entries.size());
+    matrix.m_values.reserve(entries.size());
+    size_t entry = 0;
+    for(size_t row = rowStarts[rank]; row < rowStarts[rank + 1]; ++row)
+    {
+        for(; entry < entries.size() && entries[entry].m_row == row; ++entry)
+            matrix.append(entries[entry].m_column, entries[entry].m_value);
+        matrix.finishRow();
+    }
+    return matrix;
+}
+
+/*!
+ * \brief Читает свои строки матрицы из файла: собственного двоичного формата или Matrix Market
+ * (определяется по сигнатуре). Номера столбцов - глобальные (коллективная операция в MPI_COMM_WORLD).
+ * \param path имя файла
+ * \param rowStarts первая строка каждого процесса (processesCount + 1 значений, последнее - размер матрицы)
+ */
+inline CsrMatrix loadMatrixRows(const std::string& path, const std::vector<size_t>& rowStarts)
+{
+    int rank, processesCount;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processesCount);
+
+    MPI_File file;
+    if(MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        throw std::runtime_error("Can not open matrix file " + path);
+
+    MatrixFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    MPI_File_read_at_all(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+
+    CsrMatrix matrix;
+    try
+    {
+        if(std::memcmp(header.m_magic, MATRIX_FILE_MAGIC, sizeof(MATRIX_FILE_MAGIC)) == 0)
+        {
+            if(header.m_version != MATRIX_FILE_VERSION || header.m_valueSize != sizeof(values_t))
+                throw std::runtime_error("Unsupported matrix file version " + path);
+            if(header.m_rows != rowStarts.back() || header.m_columns != rowStarts.back())
+                throw std::runtime_error("Matrix size in " + path + " does not match the system size");
+            matrix = loadNativeMatrixRows(file, header, rowStarts, rank);
+        }
+        else
+            matrix = loadMatrixMarketRows(file, path, rowStarts, rank, processesCount);
+    }
+    catch(...)
+    {
+        MPI_File_close(&file);
+        throw;
+    }
+
+    MPI_File_close(&file);
+    return matrix;
+}
+
+/*!
+ * \brief Записывает строки всех процессов в собственный двоичный формат (коллективная операция в MPI_COMM_WORLD)
+ * \param path имя файла
+ * \param matrix свои строки с глобальными номерами столбцов
+ * \param rowStarts первая строка каждого процесса
+ */
+inline void saveMatrixRows(const std::string& path, const CsrMatrix& matrix, const std::vector<size_t>& rowStarts)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    uint64_t nonZeros = matrix.nonZeros();
+    uint64_t first = 0;
+    MPI_Exscan(&nonZeros, &first, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if(!rank)
+        first = 0;
+    uint64_t totalNonZeros = 0;
+    MPI_Allreduce(&nonZeros, &totalNonZeros, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    MatrixFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.m_magic, MATRIX_FILE_MAGIC, sizeof(MATRIX_FILE_MAGIC));
+    header.m_version = MATRIX_FILE_VERSION;
+    header.m_valueSize = sizeof(values_t);
+    header.m_rows = rowStarts.back();
+    header.m_columns = rowStarts.back();
+    header.m_nonZeros = totalNonZeros;
+    header.m_rowOffsetsOffset = matrixFileAligned(sizeof(MatrixFileHeader));
+    header.m_columnsOffset = matrixFileAligned(header.m_rowOffsetsOffset + (header.m_rows + 1) * sizeof(uint64_t));
+    header.m_valuesOffset = matrixFileAligned(header.m_columnsOffset + totalNonZeros * sizeof(uint64_t));
+
+    //Последний процесс дописывает смещение конца матрицы
+    const bool last = rowStarts[rank + 1] == rowStarts.back();
+    std::vector<uint64_t> offsets(matrix.rows() + (last ? 1 : 0));
+    for(size_t row = 0; row < offsets.size(); ++row)
+        offsets[row] = first + matrix.m_rowOffsets[row];
+    const std::vector<uint64_t> columns(matrix.m_columns.begin(), matrix.m_columns.end());
+
+    //Старый файл удаляется, чтобы не осталось хвоста большей матрицы
+    if(!rank)
+        MPI_File_delete(path.c_str(), MPI_INFO_NULL);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    MPI_File file;
+    if(MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &file)
+       != MPI_SUCCESS)
+        throw std::runtime_error("Can not create matrix file " + path);
+
+    MPI_File_write_at_all(file, 0, &header, rank ? 0 : sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(file, header.m_rowOffsetsOffset + rowStarts[rank] * sizeof(uint64_t), offsets.data(),
+                          offsets.size(), MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(file, header.m_columnsOffset + first * sizeof(uint64_t), columns.data(), columns.size(),
+                          MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(file, header.m_valuesOffset + first * sizeof(values_t), matrix.m_values.data(),
+                          matrix.m_values.size(), MPI_VALUES_TYPE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+}
+
+#endif // MATRIXLOADER_H
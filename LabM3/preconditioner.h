@@ -0,0 +1,202 @@
+#ifndef PRECONDITIONER_H
+#define PRECONDITIONER_H
+
+#include "lab3types.h"
+#include "sparsematrix.h"
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+/*!
+ * \brief Предобуславливатель на строках процесса: result = M^-1 residual.
+ * Все варианты используют только свой диагональный блок матрицы, поэтому применяются без обмена.
+ */
+class Preconditioner
+{
+public:
+    virtual ~Preconditioner() {}
+
+    /*!
+     * \param residual своя часть невязки
+     * \param result своя часть предобусловленной невязки
+     */
+    virtual void apply(const values_t* residual, values_t* result) const = 0;
+};
+
+/*!
+ * \brief Предобуславливатель Якоби (диагональ матрицы)
+ */
+class JacobiPreconditioner: public Preconditioner
+{
+public:
+    /*!
+     * \param diagonal диагональные элементы своих строк
+     */
+    explicit JacobiPreconditioner(const std::vector<values_t>& diagonal):
+        m_inverseDiagonal(diagonal.size())
+    {
+        for(size_t row = 0; row < diagonal.size(); ++row)
+            m_inverseDiagonal[row] = 1 / diagonal[row];
+    }
+
+    virtual void apply(const values_t* residual, values_t* result) const
+    {
+        for(size_t row = 0; row < m_inverseDiagonal.size(); ++row)
+            result[row] = m_inverseDiagonal[row] * residual[row];
+    }
+
+private:
+    std::vector<values_t> m_inverseDiagonal;
+};
+
+/*!
+ * \brief Блочный предобуславливатель Якоби с точным разложением Холецкого плотного диагонального блока.
+ * Разложение стоит size^3 / 3 операций и size^2 памяти.
+ */
+class CholeskyPreconditioner: public Preconditioner
+{
+public:
+    /*!
+     * \param block диагональный блок построчно (size x size, симметричный положительно определенный)
+     * \param size сторона блока
+     */
+    CholeskyPreconditioner(std::vector<values_t> block, const size_t size):
+        m_factor(std::move(block)),
+        m_size(size)
+    {
+        //Нижний треугольник блока заменяется множителем L (A = L L^T), верхний не используется
+        for(size_t row = 0; row < m_size; ++row)
+        {
+            values_t* rowValues = &m_factor[row * m_size];
+            for(size_t column = 0; column <= row; ++column)
+            {
+                const values_t* columnValues = &m_factor[column * m_size];
+                values_t sum = rowValues[column];
+                for(size_t index = 0; index < column; ++index)
+                    sum -= rowValues[index] * columnValues[index];
+
+                if(column < row)
+                    rowValues[column] = sum / columnValues[column];
+                else if(sum > 0)
+                    rowValues[column] = std::sqrt(sum);
+                else
+                    throw std::runtime_error("Diagonal block is not positive definite");
+            }
+        }
+    }
+
+    virtual void apply(const values_t* residual, values_t* result) const
+    {
+        //L y = residual
+        for(size_t row = 0; row < m_size; ++row)
+        {
+            const values_t* rowValues = &m_factor[row * m_size];
+            values_t sum = residual[row];
+            for(size_t column = 0; column < row; ++column)
+                sum -= rowValues[column] * result[column];
+            result[row] = sum / rowValues[row];
+        }
+
+        //L^T result = y: столбец L^T - строка L
+        for(size_t row = m_size; row > 0; --row)
+        {
+            const values_t* rowValues = &m_factor[(row - 1) * m_size];
+            result[row - 1] /= rowValues[row - 1];
+            for(size_t column = 0; column + 1 < row; ++column)
+                result[column] -= rowValues[column] * result[row - 1];
+        }
+    }
+
+private:
+    std::vector<values_t> m_factor;
+    const size_t m_size;
+};
+
+/*!
+ * \brief Неполное разложение Холецкого IC(0) разреженного диагонального блока: множитель L
+ * имеет тот же портрет, что и нижний треугольник блока. Для симметричной матрицы совпадает с ILU(0).
+ */
+class IncompleteCholeskyPreconditioner: public Preconditioner
+{
+public:
+    /*!
+     * \param matrix строки процесса; номера столбцов - индексы расширенного вектора (GhostExchange),
+     * в каждой строке по возрастанию
+     * \param ownedCount количество своих строк (столбцы за ним принадлежат соседям и отбрасываются)
+     */
+    IncompleteCholeskyPreconditioner(const CsrMatrix& matrix, const size_t ownedCount)
+    {
+        for(size_t row = 0; row < ownedCount; ++row)
+        {
+            for(size_t index = matrix.m_rowOffsets[row]; index < matrix.m_rowOffsets[row + 1]; ++index)
+                if(matrix.m_columns[index] <= row)
+                    m_factor.append(matrix.m_columns[index], matrix.m_values[index]);
+            m_factor.finishRow();
+        }
+
+        for(size_t row = 0; row < ownedCount; ++row)
+        {
+            const size_t first = m_factor.m_rowOffsets[row];
+            const size_t last = m_factor.m_rowOffsets[row + 1];
+            if(first == last || m_factor.m_columns[last - 1] != row)
+                throw std::runtime_error("Diagonal block has no diagonal element");
+
+            for(size_t index = first; index < last; ++index)
+            {
+                const size_t column = m_factor.m_columns[index];
+
+                //Сумма L[row][k] * L[column][k] по общим k < column (обе строки упорядочены)
+                values_t sum = m_factor.m_values[index];
+                size_t rowIndex = first;
+                size_t columnIndex = m_factor.m_rowOffsets[column];
+                while(rowIndex < index && m_factor.m_columns[columnIndex] < column)
+                {
+                    if(m_factor.m_columns[rowIndex] < m_factor.m_columns[columnIndex])
+                        ++rowIndex;
+                    else if(m_factor.m_columns[rowIndex] > m_factor.m_columns[columnIndex])
+                        ++columnIndex;
+                    else
+                        sum -= m_factor.m_values[rowIndex++] * m_factor.m_values[columnIndex++];
+                }
+
+                if(column < row)
+                    m_factor.m_values[index] = sum / m_factor.m_values[m_factor.m_rowOffsets[column + 1] - 1];
+                else if(sum > 0)
+                    m_factor.m_values[index] = std::sqrt(sum);
+                else
+                    throw std::runtime_error("Incomplete factorization broke down");
+            }
+        }
+    }
+
+    virtual void apply(const values_t* residual, values_t* result) const
+    {
+        const size_t rows = m_factor.rows();
+
+        //L y = residual (диагональ - последний элемент строки)
+        for(size_t row = 0; row < rows; ++row)
+        {
+            const size_t last = m_factor.m_rowOffsets[row + 1] - 1;
+            values_t sum = residual[row];
+            for(size_t index = m_factor.m_rowOffsets[row]; index < last; ++index)
+                sum -= m_factor.m_values[index] * result[m_factor.m_columns[index]];
+            result[row] = sum / m_factor.m_values[last];
+        }
+
+        //L^T result = y
+        for(size_t row = rows; row > 0; --row)
+        {
+            const size_t last = m_factor.m_rowOffsets[row] - 1;
+            result[row - 1] /= m_factor.m_values[last];
+            for(size_t index = m_factor.m_rowOffsets[row - 1]; index < last; ++index)
+                result[m_factor.m_columns[index]] -= m_factor.m_values[index] * result[row - 1];
+        }
+    }
+
+private:
+    CsrMatrix m_factor;//!< Нижний треугольник L по строкам
+};
+
+#endif // PRECONDITIONER_H
@@ -0,0 +1,114 @@
+#ifndef PROCESSGRID_H
+#define PROCESSGRID_H
+
+#include "lab3types.h"
+
+#include <mpi.h>
+
+#include <cstddef>
+
+/*!
+ * \brief Квадратная решетка процессов side x side для двумерного разбиения матрицы.
+ * Процесс (row, column) хранит блок матрицы на пересечении полосы строк row и полосы столбцов column
+ * и часть векторов длины pieceSize с номером rank = row * side + column (как при разбиении по строкам).
+ * Полоса столбцов column состоит из частей процессов строки решетки column.
+ */
+class ProcessGrid
+{
+public:
+    /*!
+     * \brief Создает решетку и коммуникаторы строк и столбцов (коллективная операция)
+     * \param side сторона решетки (side * side - количество процессов)
+     */
+    explicit ProcessGrid(const int side):
+        m_side(side)
+    {
+        int dims[2] = {side, side};
+        int periods[2] = {0, 0};
+        //Без перенумерации: номер в решетке совпадает с номером в MPI_COMM_WORLD
+        MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &m_gridComm);
+
+        int rank, coords[2];
+        MPI_Comm_rank(m_gridComm, &rank);
+        MPI_Cart_coords(m_gridComm, rank, 2, coords);
+        m_row = coords[0];
+        m_column = coords[1];
+
+        int rowRemains[2] = {0, 1};
+        MPI_Cart_sub(m_gridComm, rowRemains, &m_rowComm);
+        int columnRemains[2] = {1, 0};
+        MPI_Cart_sub(m_gridComm, columnRemains, &m_columnComm);
+    }
+
+    ProcessGrid(const ProcessGrid&) = delete;
+    ProcessGrid& operator=(const ProcessGrid&) = delete;
+
+    ~ProcessGrid()
+    {
+        MPI_Comm_free(&m_columnComm);
+        MPI_Comm_free(&m_rowComm);
+        MPI_Comm_free(&m_gridComm);
+    }
+
+    int side() const
+    {
+        return m_side;
+    }
+
+    int row() const
+    {
+        return m_row;
+    }
+
+    int column() const
+    {
+        return m_column;
+    }
+
+    /*!
+     * \brief Собирает полосу вектора, соответствующую своей полосе столбцов матрицы.
+     * Часть отправляется процессу, симметричному относительно диагонали решетки, затем полоса
+     * собирается в коммуникаторе столбца. Каждый процесс передает O(N / side) значений вместо O(N).
+     * \param piece своя часть вектора (pieceSize значений)
+     * \param pieceSize размер части
+     * \param columnBlock полоса вектора (side * pieceSize значений)
+     */
+    void gatherColumnBlock(const values_t* piece, const size_t pieceSize, values_t* columnBlock) const
+    {
+        int transposedCoords[2] = {m_column, m_row};
+        int transposed;
+        MPI_Cart_rank(m_gridComm, transposedCoords, &transposed);
+
+        //Часть процесса (column, row) - кусок row полосы column
+        MPI_Sendrecv(piece, pieceSize, MPI_VALUES_TYPE, transposed, GRID_TRANSPOSE_TAG,
+                     columnBlock + m_row * pieceSize, pieceSize, MPI_VALUES_TYPE, transposed, GRID_TRANSPOSE_TAG,
+                     m_gridComm, MPI_STATUS_IGNORE);
+
+        MPI_Allgather(MPI_IN_PLACE, pieceSize, MPI_VALUES_TYPE, columnBlock, pieceSize, MPI_VALUES_TYPE,
+                      m_columnComm);
+    }
+
+    /*!
+     * \brief Складывает частичные произведения полосы строк по строке решетки;
+     * каждый процесс получает свою часть суммы
+     * \param partialBlock частичное произведение своего блока (side * pieceSize значений)
+     * \param pieceSize размер части
+     * \param piece своя часть результата
+     */
+    void reduceRowBlock(const values_t* partialBlock, const size_t pieceSize, values_t* piece) const
+    {
+        MPI_Reduce_scatter_block(partialBlock, piece, pieceSize, MPI_VALUES_TYPE, MPI_SUM, m_rowComm);
+    }
+
+private:
+    static const int GRID_TRANSPOSE_TAG = 43;
+
+    const int m_side;
+    int m_row;//!< Номер строки решетки (полоса строк матрицы)
+    int m_column;//!< Номер столбца решетки (полоса столбцов матрицы)
+    MPI_Comm m_gridComm;
+    MPI_Comm m_rowComm;//!< Процессы той же строки решетки, номер в нем - столбец
+    MPI_Comm m_columnComm;//!< Процессы того же столбца решетки, номер в нем - строка
+};
+
+#endif // PROCESSGRID_H
@@ -0,0 +1,220 @@
+#ifndef SPARSEMATRIX_H
+#define SPARSEMATRIX_H
+
+#include "lab3types.h"
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*!
+ * \brief Блок строк разреженной матрицы в формате CSR.
+ * Значения строки row лежат в m_values[m_rowOffsets[row] .. m_rowOffsets[row + 1]),
+ * номера их столбцов - в m_columns по тем же индексам.
+ */
+struct CsrMatrix
+{
+    CsrMatrix():
+        m_rowOffsets(1, 0u)
+    {}
+
+    size_t rows() const
+    {
+        return m_rowOffsets.size() - 1;
+    }
+
+    size_t nonZeros() const
+    {
+        return m_values.size();
+    }
+
+    /*!
+     * \brief Добавляет элемент в конец последней начатой строки
+     */
+    void append(const size_t column, const values_t value)
+    {
+        m_columns.push_back(column);
+        m_values.push_back(value);
+    }
+
+    /*!
+     * \brief Завершает текущую строку
+     */
+    void finishRow()
+    {
+        m_rowOffsets.push_back(m_values.size());
+    }
+
+    /*!
+     * \brief Умножение блока на вектор
+     * \param vector вектор, индексируемый номерами столбцов блока
+     * \param result rows() значений
+     */
+    void multiply(const values_t* vector, values_t* result) const
+    {
+        for(size_t row = 0; row < rows(); ++row)
+        {
+            values_t value = 0;
+            for(size_t index = m_rowOffsets[row]; index < m_rowOffsets[row + 1]; ++index)
+                value += m_values[index] * vector[m_columns[index]];
+            result[row] = value;
+        }
+    }
+
+    std::vector<size_t> m_rowOffsets;//!< Начало каждой строки в m_columns/m_values (rows() + 1 значений)
+    std::vector<size_t> m_columns;//!< Номера столбцов
+    std::vector<values_t> m_values;//!< Ненулевые значения
+};
+
+/*!
+ * \brief План обмена частями вектора для распределенного умножения разреженной матрицы на вектор.
+ * Строится один раз по портрету локального блока строк: процесс получает только те элементы
+ * чужих частей вектора, на которые ссылаются его строки ("призрачные" элементы), и только от их владельцев.
+ * Локальный (расширенный) вектор устроен так: [0, ownedCount) - своя часть, далее призрачные элементы,
+ * сгруппированные по владельцам в порядке возрастания глобальных номеров.
+ */
+class GhostExchange
+{
+public:
+    /*!
+     * \brief Строит план обмена и переводит номера столбцов матрицы в индексы расширенного вектора
+     * (коллективная операция)
+     * \param matrix локальный блок строк с глобальными номерами столбцов
+     * \param rowStarts первая строка каждого процесса (processesCount + 1 значений, последнее - N)
+     * \param comm коммуникатор
+     */
+    GhostExchange(CsrMatrix& matrix, const std::vector<size_t>& rowStarts, MPI_Comm comm):
+        m_comm(comm)
+    {
+        int rank, processesCount;
+        MPI_Comm_rank(m_comm, &rank);
+        MPI_Comm_size(m_comm, &processesCount);
+
+        const size_t firstRow = rowStarts[rank];
+        m_ownedCount = rowStarts[rank + 1] - firstRow;
+
+        std::vector<uint64_t> ghosts;
+        for(const size_t column : matrix.m_columns)
+            if(column < firstRow || column >= firstRow + m_ownedCount)
+                ghosts.push_back(column);
+        std::sort(ghosts.begin(), ghosts.end());
+        ghosts.erase(std::unique(ghosts.begin(), ghosts.end()), ghosts.end());
+        m_ghostsCount = ghosts.size();
+
+        //Части вектора лежат по процессам подряд, поэтому призрачные элементы уже сгруппированы по владельцам
+        std::vector<int> requestCounts(processesCount, 0);
+        for(const uint64_t column : ghosts)
+            ++requestCounts[ownerOf(rowStarts, column)];
+
+        std::vector<int> sendCounts(processesCount, 0);
+        MPI_Alltoall(requestCounts.data(), 1, MPI_INT, sendCounts.data(), 1, MPI_INT, m_comm);
+
+        std::vector<int> requestOffsets(processesCount, 0), sendOffsets(processesCount, 0);
+        for(int process = 1; process < processesCount; ++process)
+        {
+            requestOffsets[process] = requestOffsets[process - 1] + requestCounts[process - 1];
+            sendOffsets[process] = sendOffsets[process - 1] + sendCounts[process - 1];
+        }
+
+        std::vector<uint64_t> sendColumns(sendOffsets.back() + sendCounts.back());
+        MPI_Alltoallv(ghosts.data(), requestCounts.data(), requestOffsets.data(), MPI_UINT64_T,
+                      sendColumns.data(), sendCounts.data(), sendOffsets.data(), MPI_UINT64_T, m_comm);
+
+        for(int process = 0; process < processesCount; ++process)
+        {
+            if(requestCounts[process])
+            {
+                m_receiveRanks.push_back(process);
+                m_receiveCounts.push_back(requestCounts[process]);
+                m_receiveOffsets.push_back(requestOffsets[process]);
+            }
+            if(sendCounts[process])
+            {
+                m_sendRanks.push_back(process);
+                m_sendCounts.push_back(sendCounts[process]);
+                m_sendOffsets.push_back(sendOffsets[process]);
+            }
+        }
+
+        m_sendIndices.reserve(sendColumns.size());
+        for(const uint64_t column : sendColumns)
+            m_sendIndices.push_back(column - firstRow);
+        m_sendBuffer.resize(m_sendIndices.size());
+        m_requests.resize(m_receiveRanks.size() + m_sendRanks.size());
+
+        for(size_t& column : matrix.m_columns)
+        {
+            if(column >= firstRow && column < firstRow + m_ownedCount)
+                column -= firstRow;
+            else
+                column = m_ownedCount + (std::lower_bound(ghosts.begin(), ghosts.end(), column) - ghosts.begin());
+        }
+    }
+
+    GhostExchange(const GhostExchange&) = delete;
+    GhostExchange& operator=(const GhostExchange&) = delete;
+
+    size_t ownedCount() const
+    {
+        return m_ownedCount;
+    }
+
+    /*!
+     * \brief Размер расширенного вектора (своя часть и призрачные элементы)
+     */
+    size_t extendedSize() const
+    {
+        return m_ownedCount + m_ghostsCount;
+    }
+
+    /*!
+     * \brief Заполняет призрачные элементы расширенного вектора значениями владельцев
+     * (вызывается всеми процессами коммуникатора)
+     * \param vector расширенный вектор (extendedSize() значений)
+     */
+    void exchange(values_t* vector)
+    {
+        size_t request = 0;
+        for(size_t index = 0; index < m_receiveRanks.size(); ++index)
+            MPI_Irecv(vector + m_ownedCount + m_receiveOffsets[index], m_receiveCounts[index], MPI_VALUES_TYPE,
+                      m_receiveRanks[index], GHOST_EXCHANGE_TAG, m_comm, &m_requests[request++]);
+
+        for(size_t index = 0; index < m_sendIndices.size(); ++index)
+            m_sendBuffer[index] = vector[m_sendIndices[index]];
+
+        for(size_t index = 0; index < m_sendRanks.size(); ++index)
+            MPI_Isend(m_sendBuffer.data() + m_sendOffsets[index], m_sendCounts[index], MPI_VALUES_TYPE,
+                      m_sendRanks[index], GHOST_EXCHANGE_TAG, m_comm, &m_requests[request++]);
+
+        MPI_Waitall(request, m_requests.data(), MPI_STATUSES_IGNORE);
+    }
+
+private:
+    static const int GHOST_EXCHANGE_TAG = 37;
+
+    static int ownerOf(const std::vector<size_t>& rowStarts, const size_t row)
+    {
+        return std::upper_bound(rowStarts.begin(), rowStarts.end(), row) - rowStarts.begin() - 1;
+    }
+
+    MPI_Comm m_comm;
+    size_t m_ownedCount;//!< Размер своей части вектора
+    size_t m_ghostsCount;//!< Количество призрачных элементов
+
+    std::vector<int> m_receiveRanks;//!< Владельцы призрачных элементов
+    std::vector<int> m_receiveCounts;
+    std::vector<int> m_receiveOffsets;//!< Смещения от начала призрачных элементов
+
+    std::vector<int> m_sendRanks;//!< Процессы, которым нужны элементы своей части
+    std::vector<int> m_sendCounts;
+    std::vector<int> m_sendOffsets;//!< Смещения в m_sendBuffer
+    std::vector<size_t> m_sendIndices;//!< Индексы отправляемых элементов в своей части
+    std::vector<values_t> m_sendBuffer;
+
+    std::vector<MPI_Request> m_requests;
+};
+
+#endif // SPARSEMATRIX_H
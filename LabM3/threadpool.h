@@ -0,0 +1,215 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*!
+ * \brief Постоянные потоки процесса для параллельных вычислительных ядер.
+ * Задача запускается сразу во всех потоках (вызывающий поток - нулевой) и run() ждет ее завершения,
+ * поэтому на каждое ядро не создаются и не уничтожаются потоки.
+ */
+class ThreadPool
+{
+public:
+    /*!
+     * \brief Конструктор
+     * \param threadsCount общее количество потоков вместе с вызывающим
+     * \param cpus процессоры, к которым привязываются потоки (поток thread - к cpus[thread]);
+     * пустой - потоки не привязываются
+     */
+    explicit ThreadPool(const size_t threadsCount, const std::vector<int>& cpus = std::vector<int>()):
+        m_task{nullptr},
+        m_generation{0},
+        m_pending{0},
+        m_stop{false}
+    {
+        for(size_t thread = 1; thread < threadsCount; ++thread)
+        {
+            m_threads.emplace_back(&ThreadPool::work, this, thread);
+            if(thread < cpus.size())
+                pin(m_threads.back().native_handle(), cpus[thread]);
+        }
+        if(!cpus.empty())
+            pin(currentThread(), cpus[0]);
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_start.notify_all();
+        for(std::thread& thread : m_threads)
+            thread.join();
+    }
+
+    size_t size() const
+    {
+        return m_threads.size() + 1;
+    }
+
+    /*!
+     * \brief Выполняет task(номер потока, количество потоков) во всех потоках и ждет завершения
+     */
+    void run(const std::function<void(size_t, size_t)>& task)
+    {
+        if(m_threads.empty())
+        {
+            task(0, 1);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_pending = m_threads.size();
+            ++m_generation;
+        }
+        m_start.notify_all();
+
+        task(0, size());
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]{ return !m_pending; });
+    }
+
+    /*!
+     * \brief Доля [begin, end) отрезка [0, count) для потока thread, границы кратны alignment
+     */
+    static void split(const size_t count, const size_t thread, const size_t threadsCount, const size_t alignment,
+                      size_t& begin, size_t& end)
+    {
+        const size_t blocks = (count + alignment - 1) / alignment;
+        begin = std::min(count, blocks * thread / threadsCount * alignment);
+        end = std::min(count, blocks * (thread + 1) / threadsCount * alignment);
+    }
+
+    /*!
+     * \brief Процессоры, на которых разрешено выполняться процессу (например, узел NUMA при --bind-to numa)
+     */
+    static std::vector<int> affinityCpus()
+    {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(sched_getaffinity(0, sizeof(set), &set) == 0)
+            for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if(CPU_ISSET(cpu, &set))
+                    cpus.push_back(cpu);
+#endif
+        return cpus;
+    }
+
+private:
+#ifdef __linux__
+    typedef pthread_t native_thread_t;
+
+    static native_thread_t currentThread()
+    {
+        return pthread_self();
+    }
+
+    static void pin(const native_thread_t thread, const int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(thread, sizeof(set), &set);
+    }
+#else
+    typedef std::thread::native_handle_type native_thread_t;
+
+    static native_thread_t currentThread()
+    {
+        return native_thread_t();
+    }
+
+    static void pin(const native_thread_t, const int)
+    {}
+#endif
+
+    void work(const size_t thread)
+    {
+        size_t generation = 0;
+        while(true)
+        {
+            const std::function<void(size_t, size_t)>* task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_start.wait(lock, [&]{ return m_stop || m_generation != generation; });
+                if(m_stop)
+                    return;
+                generation = m_generation;
+                task = m_task;
+            }
+
+            (*task)(thread, size());
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(!--m_pending)
+                m_done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    const std::function<void(size_t, size_t)>* m_task;//!< Текущая задача
+    size_t m_generation;//!< Номер запуска (поток берет задачу, когда номер меняется)
+    size_t m_pending;//!< Потоков, еще выполняющих задачу
+    bool m_stop;
+};
+
+/*!
+ * \brief Распределитель, не инициализирующий элементы при создании вектора нужного размера.
+ * Страницы памяти выделяются при первой записи на узле NUMA записавшего потока, поэтому вектор,
+ * заполненный потоками пула, лежит в памяти тех потоков, которые потом его читают.
+ */
+template<typename T>
+struct FirstTouchAllocator: std::allocator<T>
+{
+    template<typename U>
+    struct rebind
+    {
+        typedef FirstTouchAllocator<U> other;
+    };
+
+    FirstTouchAllocator() = default;
+
+    template<typename U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&)
+    {}
+
+    template<typename U>
+    void construct(U* pointer)
+    {
+        ::new(static_cast<void*>(pointer)) U;
+    }
+
+    template<typename U, typename... Args>
+    void construct(U* pointer, Args&&... args)
+    {
+        ::new(static_cast<void*>(pointer)) U(std::forward<Args>(args)...);
+    }
+};
+
+#endif // THREADPOOL_H
@@ -12,6 +12,31 @@
 //Вывод результирующей матрицы в консоль
 //#define PRINT_MATRIX
 
+//Запись результирующего поля в файл field.dat (просмотр: FieldViewer --heatmap)
+//#define FILE_SAVE
+
+//Запись результирующего поля в снимок field.snap (просмотр: FieldViewer field.snap)
+//#define SNAPSHOT_SAVE
+
+//Решение методом сопряженных градиентов с оператором Лапласа без хранения матрицы
+//вместо красно-черного метода Зейделя
+//#define CG_SOLVER
+
+//Предобуславливание метода сопряженных градиентов симметричным шагом Зейделя по своему куску
+//#define CG_PRECONDITIONER
+
+#if defined(CG_PRECONDITIONER) && !defined(CG_SOLVER)
+#error "CG_PRECONDITIONER requires CG_SOLVER"
+#endif
+
+#ifdef SNAPSHOT_SAVE
+#   include "snapshot.h"
+#endif
+
+#ifdef CG_SOLVER
+#   include "stenciloperator.h"
+#endif
+
 const values_t X_SIDE = 1.;
 const values_t Y_SIDE = 2.;
 
@@ -30,6 +55,11 @@ const values_t EPSILON = .0001;//!< Точность сходимости нев
 const size_t STEPS_PER_ITERATION = 10u;//!<  Количество шагов в одной итерации между которыми не вычисляется невязка
 const size_t ITERATIONS = 5000u;//!< Количество итераций (одна итерация = STEPS_PER_ITERATION шагов)
 
+#ifdef CG_SOLVER
+const values_t CG_TOLERANCE = 1e-8;//!< Итерации CG прекращаются, когда |r| / |b| не больше этого значения
+const size_t CG_ITERATIONS = ITERATIONS * STEPS_PER_ITERATION;//!< Наибольшее количество итераций CG
+#endif
+
 //Тэги сообщений
 const int SENT_UP_BOUND_TAG = 1;
 const int SENT_DOWN_BOUND_TAG = 2;
@@ -240,6 +270,47 @@ IterationsResult doZeidelIterations(ExtendedSlice& extendedSlice, const MPI_Comm
     return std::make_pair(oldResidual, ITERATIONS - iterations);;
 }
 
+#ifdef CG_SOLVER
+/*!
+ * \brief Решает систему пятиточечного оператора Лапласа методом сопряженных градиентов,
+ * общая функция для всех процессов. Граничные значения поля переносятся в правую часть,
+ * начальное приближение - текущие значения куска.
+ * \param extendedSlice кусок поля (сюда же записывается решение)
+ * \param netComm коммуникатор декартовой топологии
+ * \return относительная невязка |r| / |b| и количество итераций
+ */
+IterationsResult doCgIterations(ExtendedSlice& extendedSlice, const MPI_Comm netComm)
+{
+    StencilOperator stencil(extendedSlice.m_strideX, extendedSlice.m_strideY, netComm);
+
+    std::vector<values_t> b(stencil.size(), 0.);
+    stencil.addBoundaryTerm(UPPER_BOUNDARY_VALUE, LOWER_BOUNDARY_VALUE, LEFT_BOUNDARY_VALUE, RIGHT_BOUNDARY_VALUE,
+                            b.data());
+
+#ifdef CG_PRECONDITIONER
+    RedBlackPreconditioner preconditioner(extendedSlice.m_strideX, extendedSlice.m_strideY);
+    LinearOperator* const preconditionerPtr = &preconditioner;
+#else
+    LinearOperator* const preconditionerPtr = nullptr;
+#endif
+
+    return conjugateGradient(stencil, preconditionerPtr, b.data(), extendedSlice.m_slice.m_values.data(), netComm,
+                             CG_TOLERANCE, CG_ITERATIONS);
+}
+#endif
+
+/*!
+ * \brief Решает задачу выбранным методом
+ */
+IterationsResult solveField(ExtendedSlice& extendedSlice, const MPI_Comm netComm)
+{
+#ifdef CG_SOLVER
+    return doCgIterations(extendedSlice, netComm);
+#else
+    return doZeidelIterations(extendedSlice, netComm);
+#endif
+}
+
 /*!
  * \brief Рабочий процесс (rank > 0).
  */
@@ -283,7 +354,7 @@ public:
 
         ExtendedSlice extendedSlice(slice);
 
-        doZeidelIterations(extendedSlice, netComm);
+        solveField(extendedSlice, netComm);
 
         MPI_Send(slice.m_values.data(), slice.m_values.size(),
                  MPI_VALUES_TYPE, mainProcessNetRank, SENT_SLICE_TAG, netComm);
@@ -347,7 +418,7 @@ public:
 
         ExtendedSlice extendedSlice(m_field.m_slices[mySliceNumber]);
 
-        const IterationsResult iterationsResult = doZeidelIterations(extendedSlice, netComm);
+        const IterationsResult iterationsResult = solveField(extendedSlice, netComm);
 
         //Собираем куски
         for(int process = 0; process < m_processesCount - 1; ++process)
@@ -391,12 +462,17 @@ public:
         itResultStream << " Residual: " << iterationsResult.first << " Iterations: " << iterationsResult.second << std::endl;
         std::cout << itResultStream.str();
 
-        //Возможная запись в файл
-//        {
-//            std::ofstream os("field.dat", std::ios::binary);
-//            boost::archive::binary_oarchive oar(os);
-//            oar << m_field;
-//        }
+#ifdef FILE_SAVE
+        {
+            std::ofstream os("field.dat", std::ios::binary);
+            boost::archive::binary_oarchive oar(os);
+            oar << m_field;
+        }
+#endif
+
+#ifdef SNAPSHOT_SAVE
+        writeSnapshot("field.snap", m_field);
+#endif
     }
 
 private:
@@ -0,0 +1,197 @@
+#ifndef STENCILOPERATOR_H
+#define STENCILOPERATOR_H
+
+#include "lab4types.h"
+#include "extendedslice.h"
+#include "linearoperator.h"
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/*!
+ * \brief Пятиточечный оператор Лапласа на куске поля без хранения матрицы: (A u)(x, y) = 4 u(x, y) - сумма
+ * четырех соседей. Соседи за краем куска берутся из границ ExtendedSlice, которые заполняются обменом
+ * с соседними процессами решетки; на границе поля они нулевые - граничные значения переносятся в правую часть.
+ * Оператор симметричен и положительно определен, поэтому к нему применим метод сопряженных градиентов.
+ */
+class StencilOperator: public LinearOperator
+{
+public:
+    /*!
+     * \param strideX ширина куска
+     * \param strideY высота куска
+     * \param netComm коммуникатор декартовой топологии
+     */
+    StencilOperator(const size_t strideX, const size_t strideY, const MPI_Comm netComm):
+        m_slice(Slice::makeZeroSlice(0, 0, strideX, strideY)),
+        m_extendedSlice(m_slice),
+        m_netComm(netComm),
+        m_sendColumn(strideY),
+        m_receiveColumn(strideY)
+    {
+        MPI_Cart_shift(m_netComm, 0, 1, &m_leftRank, &m_rightRank);
+        MPI_Cart_shift(m_netComm, 1, 1, &m_upperRank, &m_lowerRank);
+    }
+
+    virtual size_t size() const
+    {
+        return m_slice.m_values.size();
+    }
+
+    virtual void apply(const values_t* vector, values_t* result)
+    {
+        std::copy(vector, vector + size(), m_slice.m_values.begin());
+        exchangeHalo();
+
+        const size_t strideX = m_extendedSlice.m_strideX;
+        const size_t strideY = m_extendedSlice.m_strideY;
+        for(size_t y = 0; y < strideY; ++y)
+        {
+            const values_t* row = m_slice.m_values.data() + y * strideX;
+            const values_t* upper = y ? row - strideX : m_extendedSlice.m_upperBound.data();
+            const values_t* lower = y + 1 < strideY ? row + strideX : m_extendedSlice.m_lowerBound.data();
+            const values_t left = m_extendedSlice.m_leftExtendedBound[y + 1];
+            const values_t right = m_extendedSlice.m_rightExtendedBound[y + 1];
+            values_t* resultRow = result + y * strideX;
+
+            for(size_t x = 0; x < strideX; ++x)
+            {
+                const values_t west = x ? row[x - 1] : left;
+                const values_t east = x + 1 < strideX ? row[x + 1] : right;
+                resultRow[x] = 4 * row[x] - west - east - upper[x] - lower[x];
+            }
+        }
+    }
+
+    /*!
+     * \brief Добавляет к правой части вклад граничных значений поля (только на краях куска без соседа)
+     * \param b своя часть правой части
+     */
+    void addBoundaryTerm(const values_t upperValue, const values_t lowerValue,
+                         const values_t leftValue, const values_t rightValue, values_t* b) const
+    {
+        const size_t strideX = m_extendedSlice.m_strideX;
+        const size_t strideY = m_extendedSlice.m_strideY;
+        for(size_t x = 0; x < strideX; ++x)
+        {
+            if(m_upperRank == MPI_PROC_NULL)
+                b[x] += upperValue;
+            if(m_lowerRank == MPI_PROC_NULL)
+                b[(strideY - 1) * strideX + x] += lowerValue;
+        }
+        for(size_t y = 0; y < strideY; ++y)
+        {
+            if(m_leftRank == MPI_PROC_NULL)
+                b[y * strideX] += leftValue;
+            if(m_rightRank == MPI_PROC_NULL)
+                b[y * strideX + strideX - 1] += rightValue;
+        }
+    }
+
+private:
+    static const int HALO_UP_TAG = 11;
+    static const int HALO_DOWN_TAG = 12;
+    static const int HALO_LEFT_TAG = 13;
+    static const int HALO_RIGHT_TAG = 14;
+
+    /*!
+     * \brief Заполняет границы куска крайними значениями соседей (углы пятиточечному шаблону не нужны)
+     */
+    void exchangeHalo()
+    {
+        const size_t strideX = m_extendedSlice.m_strideX;
+        const size_t strideY = m_extendedSlice.m_strideY;
+        const values_t* values = m_slice.m_values.data();
+
+        //MPI_PROC_NULL пропускается, поэтому границы поля остаются нулевыми
+        MPI_Sendrecv(values, strideX, MPI_VALUES_TYPE, m_upperRank, HALO_UP_TAG,
+                     m_extendedSlice.m_lowerBound.data(), strideX, MPI_VALUES_TYPE, m_lowerRank, HALO_UP_TAG,
+                     m_netComm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv(values + (strideY - 1) * strideX, strideX, MPI_VALUES_TYPE, m_lowerRank, HALO_DOWN_TAG,
+                     m_extendedSlice.m_upperBound.data(), strideX, MPI_VALUES_TYPE, m_upperRank, HALO_DOWN_TAG,
+                     m_netComm, MPI_STATUS_IGNORE);
+
+        for(size_t y = 0; y < strideY; ++y)
+            m_sendColumn[y] = values[y * strideX];
+        MPI_Sendrecv(m_sendColumn.data(), strideY, MPI_VALUES_TYPE, m_leftRank, HALO_LEFT_TAG,
+                     m_extendedSlice.m_rightExtendedBound.data() + 1, strideY, MPI_VALUES_TYPE, m_rightRank,
+                     HALO_LEFT_TAG, m_netComm, MPI_STATUS_IGNORE);
+
+        for(size_t y = 0; y < strideY; ++y)
+            m_sendColumn[y] = values[y * strideX + strideX - 1];
+        MPI_Sendrecv(m_sendColumn.data(), strideY, MPI_VALUES_TYPE, m_rightRank, HALO_RIGHT_TAG,
+                     m_receiveColumn.data(), strideY, MPI_VALUES_TYPE, m_leftRank, HALO_RIGHT_TAG,
+                     m_netComm, MPI_STATUS_IGNORE);
+        if(m_leftRank != MPI_PROC_NULL)
+            std::copy(m_receiveColumn.begin(), m_receiveColumn.end(),
+                      m_extendedSlice.m_leftExtendedBound.begin() + 1);
+    }
+
+    Slice m_slice;//!< Умножаемый вектор в виде куска поля
+    ExtendedSlice m_extendedSlice;//!< Кусок с границами от соседей
+    const MPI_Comm m_netComm;
+    int m_upperRank;
+    int m_lowerRank;
+    int m_leftRank;
+    int m_rightRank;
+    std::vector<values_t> m_sendColumn;//!< Буфер отправляемого столбца
+    std::vector<values_t> m_receiveColumn;//!< Буфер принимаемого левого столбца
+};
+
+/*!
+ * \brief Предобуславливатель: симметричный красно-черный шаг Зейделя (красные, черные, красные точки)
+ * по своему куску от нулевого приближения с нулевыми границами, то есть блочный Якоби с приближенным
+ * решением блока. Обмена не требует; как и Зейдель, гасит высокочастотную часть невязки.
+ */
+class RedBlackPreconditioner: public LinearOperator
+{
+public:
+    RedBlackPreconditioner(const size_t strideX, const size_t strideY):
+        m_strideX(strideX),
+        m_strideY(strideY)
+    {}
+
+    virtual size_t size() const
+    {
+        return m_strideX * m_strideY;
+    }
+
+    virtual void apply(const values_t* residual, values_t* result)
+    {
+        std::fill(result, result + size(), values_t(0));
+        sweep(0, residual, result);
+        sweep(1, residual, result);
+        sweep(0, residual, result);
+    }
+
+private:
+    /*!
+     * \brief Обновляет точки одного цвета ((x + y) % 2 == color) по соседям другого цвета
+     */
+    void sweep(const size_t color, const values_t* residual, values_t* result) const
+    {
+        for(size_t y = 0; y < m_strideY; ++y)
+            for(size_t x = (y + color) % 2; x < m_strideX; x += 2)
+            {
+                const size_t index = y * m_strideX + x;
+                values_t sum = residual[index];
+                if(x)
+                    sum += result[index - 1];
+                if(x + 1 < m_strideX)
+                    sum += result[index + 1];
+                if(y)
+                    sum += result[index - m_strideX];
+                if(y + 1 < m_strideY)
+                    sum += result[index + m_strideX];
+                result[index] = sum / 4;
+            }
+    }
+
+    const size_t m_strideX;
+    const size_t m_strideY;
+};
+
+#endif // STENCILOPERATOR_H
@@ -0,0 +1,263 @@
+#ifndef DEEPEXTENDEDSLICE_H
+#define DEEPEXTENDEDSLICE_H
+
+#include "slice.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+/*!
+ * \brief Кусок поля с границами глубины m_depth.
+ * Позволяет сделать до m_depth шагов игры за один обмен границами.
+ * Шаги выполняются по полосам строк (временная блокировка): полоса вместе с границами
+ * помещается в кэш и проходит все шаги подряд, область вычислений сужается трапецией.
+ */
+struct DeepExtendedSlice
+{
+    /*!
+     * \brief Конструктор
+     * \param slice кусок поля
+     * \param depth глубина границ (максимальное число шагов между обменами)
+     * \param tileBytes объем памяти, отводимый под полосу (две копии с границами)
+     */
+    DeepExtendedSlice(Slice& slice, const size_t depth, const size_t tileBytes):
+                m_slice(slice),
+                m_strideX{m_slice.m_stride},
+                m_strideY{m_slice.m_values.size() / m_strideX},
+                m_depth{depth},
+                m_extendedX{m_strideX + 2 * m_depth},
+                m_deadUpper{false},
+                m_deadLower{false},
+                m_deadLeft{false},
+                m_deadRight{false}
+    {
+        assert(m_depth > 0);
+        assert(m_depth <= m_strideX && m_depth <= m_strideY);
+
+        m_upperBound.resize(m_depth * m_strideX, 0);
+        m_lowerBound.resize(m_depth * m_strideX, 0);
+        m_leftExtendedBound.resize((m_strideY + 2 * m_depth) * m_depth, 0);
+        m_rightExtendedBound.resize((m_strideY + 2 * m_depth) * m_depth, 0);
+        m_next.resize(m_slice.m_values.size(), 0);
+
+        const size_t tileRows = tileBytes / (2 * m_extendedX * sizeof(values_t));
+        m_tileRows = std::min(m_strideY, std::max(m_depth, tileRows > 2 * m_depth ? tileRows - 2 * m_depth : 0));
+        m_tile[0].resize((m_tileRows + 2 * m_depth) * m_extendedX, 0);
+        m_tile[1].resize((m_tileRows + 2 * m_depth) * m_extendedX, 0);
+        m_rowAlive[0].resize(m_tileRows + 2 * m_depth, 0);
+        m_rowAlive[1].resize(m_tileRows + 2 * m_depth, 0);
+    }
+
+    /*!
+     * \brief Помечает внешние границы поля (вне поля клетки всегда мертвы)
+     */
+    void setDeadBounds(const bool upper, const bool lower, const bool left, const bool right)
+    {
+        m_deadUpper = upper;
+        m_deadLower = lower;
+        m_deadLeft = left;
+        m_deadRight = right;
+    }
+
+    /*!
+     * \brief Верхние m_depth строк куска (для соседа сверху)
+     */
+    std::vector<values_t> getUpperRows() const
+    {
+        return std::vector<values_t>{m_slice.m_values.begin(), m_slice.m_values.begin() + m_depth * m_strideX};
+    }
+
+    /*!
+     * \brief Нижние m_depth строк куска (для соседа снизу)
+     */
+    std::vector<values_t> getLowerRows() const
+    {
+        return std::vector<values_t>{m_slice.m_values.end() - m_depth * m_strideX, m_slice.m_values.end()};
+    }
+
+    /*!
+     * \brief Первые m_depth столбцов куска вместе с верхней и нижней границами (построчно)
+     */
+    std::vector<values_t> getFirstExtendedColumns() const
+    {
+        return getExtendedColumns(0);
+    }
+
+    /*!
+     * \brief Последние m_depth столбцов куска вместе с верхней и нижней границами (построчно)
+     */
+    std::vector<values_t> getLastExtendedColumns() const
+    {
+        return getExtendedColumns(m_strideX - m_depth);
+    }
+
+    /*!
+     * \brief Делает несколько шагов игры, используя текущие границы
+     * \param steps количество шагов (не больше глубины границ)
+     */
+    void lifeSteps(const size_t steps)
+    {
+        assert(steps <= m_depth);
+        if(!steps)
+            return;
+
+        for(size_t tileY = 0; tileY < m_strideY; tileY += m_tileRows)
+        {
+            const size_t tileHeight = std::min(m_tileRows, m_strideY - tileY);
+            const size_t bufferRows = tileHeight + 2 * m_depth;
+
+            for(size_t row = 0; row < bufferRows; ++row)
+            {
+                values_t* const rowData = &m_tile[0][row * m_extendedX];
+                loadRow(static_cast<ptrdiff_t>(tileY + row) - static_cast<ptrdiff_t>(m_depth), rowData);
+                m_rowAlive[0][row] = m_rowAlive[1][row] = anyAlive(rowData, 0, m_extendedX);
+            }
+            std::memcpy(m_tile[1].data(), m_tile[0].data(), bufferRows * m_extendedX * sizeof(values_t));
+
+            //Строки полосы, которые разрешено пересчитывать (за мертвой границей клетки не оживают)
+            const size_t rowBegin = (m_deadUpper && tileY < m_depth) ? m_depth - tileY : 0;
+            const size_t rowEnd = m_deadLower ? std::min(bufferRows, m_strideY + m_depth - tileY) : bufferRows;
+            const size_t columnBegin = m_deadLeft ? m_depth : 0;
+            const size_t columnEnd = m_deadRight ? m_depth + m_strideX : m_extendedX;
+
+            for(size_t step = 1; step <= steps; ++step)
+            {
+                const values_t* source = m_tile[(step - 1) % 2].data();
+                values_t* destination = m_tile[step % 2].data();
+                const std::vector<char>& sourceAlive = m_rowAlive[(step - 1) % 2];
+                std::vector<char>& destinationAlive = m_rowAlive[step % 2];
+
+                const size_t firstRow = std::max(step, rowBegin);
+                const size_t lastRow = std::min(bufferRows - step, rowEnd);
+                const size_t firstColumn = std::max(step, columnBegin);
+                const size_t lastColumn = std::min(m_extendedX - step, columnEnd);
+
+                for(size_t row = firstRow; row < lastRow; ++row)
+                {
+                    values_t* const destinationRow = destination + row * m_extendedX;
+
+                    //Вокруг пустых строк жизнь не зарождается - пропускаем их (стоимость куска следует за активностью)
+                    if(!sourceAlive[row - 1] && !sourceAlive[row] && !sourceAlive[row + 1])
+                    {
+                        std::memset(destinationRow + firstColumn, 0, (lastColumn - firstColumn) * sizeof(values_t));
+                        destinationAlive[row] = 0;
+                        continue;
+                    }
+
+                    lifeRow(source + (row - 1) * m_extendedX,
+                            source + row * m_extendedX,
+                            source + (row + 1) * m_extendedX,
+                            destinationRow,
+                            firstColumn, lastColumn);
+                    destinationAlive[row] = anyAlive(destinationRow, firstColumn, lastColumn);
+                }
+            }
+
+            const values_t* result = m_tile[steps % 2].data();
+            for(size_t row = 0; row < tileHeight; ++row)
+                std::memcpy(&m_next[(tileY + row) * m_strideX],
+                            result + (m_depth + row) * m_extendedX + m_depth,
+                            m_strideX * sizeof(values_t));
+        }
+
+        m_slice.m_values.swap(m_next);
+    }
+
+    /*!
+     * \brief Хэш клеток куска (см. cellsHash)
+     */
+    uint64_t hash() const
+    {
+        uint64_t result = 0;
+        for(size_t row = 0; row < m_strideY; ++row)
+            result += cellsHash(m_slice.m_values.data() + row * m_strideX, m_strideX,
+                                m_slice.m_globalX, m_slice.m_globalY + row);
+        return result;
+    }
+
+    Slice& m_slice;
+    const size_t m_strideX;
+    const size_t m_strideY;
+    const size_t m_depth;//!< Глубина границ
+    const size_t m_extendedX;//!< Ширина куска вместе с левой и правой границами
+    std::vector<values_t> m_upperBound;//!< m_depth строк над куском
+    std::vector<values_t> m_lowerBound;//!< m_depth строк под куском
+    std::vector<values_t> m_leftExtendedBound;//!< m_depth столбцов слева (построчно, с углами)
+    std::vector<values_t> m_rightExtendedBound;//!< m_depth столбцов справа (построчно, с углами)
+
+private:
+    std::vector<values_t> getExtendedColumns(const size_t firstColumn) const
+    {
+        std::vector<values_t> columns(m_leftExtendedBound.size());
+        for(size_t row = 0; row < m_strideY + 2 * m_depth; ++row)
+        {
+            const ptrdiff_t sliceRow = static_cast<ptrdiff_t>(row) - static_cast<ptrdiff_t>(m_depth);
+            std::memcpy(&columns[row * m_depth], sliceRowData(sliceRow) + firstColumn, m_depth * sizeof(values_t));
+        }
+        return columns;
+    }
+
+    /*!
+     * \brief Строка куска или верхней/нижней границы без левой и правой частей
+     * \param sliceRow номер строки относительно куска (от -m_depth до m_strideY + m_depth)
+     */
+    const values_t* sliceRowData(const ptrdiff_t sliceRow) const
+    {
+        if(sliceRow < 0)
+            return &m_upperBound[(sliceRow + m_depth) * m_strideX];
+        if(sliceRow >= static_cast<ptrdiff_t>(m_strideY))
+            return &m_lowerBound[(sliceRow - m_strideY) * m_strideX];
+        return &m_slice.m_values[sliceRow * m_strideX];
+    }
+
+    /*!
+     * \brief Копирует строку поля вместе с левой и правой границами в буфер полосы
+     */
+    void loadRow(const ptrdiff_t sliceRow, values_t* destination) const
+    {
+        const size_t extendedRow = sliceRow + m_depth;
+        std::memcpy(destination, &m_leftExtendedBound[extendedRow * m_depth], m_depth * sizeof(values_t));
+        std::memcpy(destination + m_depth, sliceRowData(sliceRow), m_strideX * sizeof(values_t));
+        std::memcpy(destination + m_depth + m_strideX, &m_rightExtendedBound[extendedRow * m_depth], m_depth * sizeof(values_t));
+    }
+
+    /*!
+     * \brief Один шаг игры для части строки (без ветвлений, векторизуется компилятором)
+     */
+    static void lifeRow(const values_t* __restrict upper, const values_t* __restrict middle,
+                        const values_t* __restrict lower, values_t* __restrict destination,
+                        const size_t firstColumn, const size_t lastColumn)
+    {
+        for(size_t column = firstColumn; column < lastColumn; ++column)
+        {
+            const int aliveNeighbors = upper[column - 1] + upper[column] + upper[column + 1] +
+                                       middle[column - 1] + middle[column + 1] +
+                                       lower[column - 1] + lower[column] + lower[column + 1];
+            destination[column] = (aliveNeighbors == 3) | (middle[column] & (aliveNeighbors == 2));
+        }
+    }
+
+    /*!
+     * \brief Есть ли живые клетки в части строки
+     */
+    static bool anyAlive(const values_t* row, const size_t firstColumn, const size_t lastColumn)
+    {
+        values_t alive = 0;
+        for(size_t column = firstColumn; column < lastColumn; ++column)
+            alive |= row[column];
+        return alive != 0;
+    }
+
+    std::vector<values_t> m_next;//!< Следующее состояние куска
+    std::vector<values_t> m_tile[2];//!< Полоса с границами (два поколения)
+    std::vector<char> m_rowAlive[2];//!< Признаки наличия живых клеток в строках полосы (два поколения)
+    size_t m_tileRows;//!< Высота полосы в строках куска
+    bool m_deadUpper;
+    bool m_deadLower;
+    bool m_deadLeft;
+    bool m_deadRight;
+};
+
+#endif // DEEPEXTENDEDSLICE_H
@@ -0,0 +1,115 @@
+#ifndef LINEAROPERATOR_H
+#define LINEAROPERATOR_H
+
+#include <mpi.h>
+
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+/*!
+ * \brief Линейный оператор на распределенном векторе: каждый процесс хранит свою часть длины size().
+ * Матрица может не храниться вовсе - оператор сам получает нужные ему значения соседних частей.
+ */
+class LinearOperator
+{
+public:
+    virtual ~LinearOperator() {}
+
+    /*!
+     * \brief Размер своей части вектора
+     */
+    virtual size_t size() const = 0;
+
+    /*!
+     * \brief result = A vector (вызывается всеми процессами коммуникатора)
+     * \param vector своя часть вектора
+     * \param result своя часть результата
+     */
+    virtual void apply(const values_t* vector, values_t* result) = 0;
+};
+
+typedef std::pair<values_t/*относительная невязка*/, size_t/*количество итераций*/> ConjugateGradientResult;
+
+/*!
+ * \brief Метод сопряженных градиентов от начального приближения x.
+ * Скалярные произведения итерации собираются одной редукцией.
+ * \param op симметричный положительно определенный оператор
+ * \param preconditioner M^-1 (симметричный положительно определенный) или nullptr
+ * \param b своя часть правой части
+ * \param x своя часть начального приближения и решения
+ * \param comm коммуникатор процессов оператора
+ * \param tolerance итерации прекращаются, когда |r| / |b| не больше этого значения
+ * \param maxIterations наибольшее количество итераций
+ * \return относительная невязка |r| / |b| и количество итераций
+ */
+inline ConjugateGradientResult conjugateGradient(LinearOperator& op, LinearOperator* preconditioner,
+                                                 const values_t* b, values_t* x, const MPI_Comm comm,
+                                                 const values_t tolerance, const size_t maxIterations)
+{
+    const size_t size = op.size();
+    std::vector<values_t> residual(size), preconditioned(size), direction(size), product(size);
+
+    auto dot = [size](const values_t* first, const values_t* second)
+    {
+        return std::inner_product(first, first + size, second, values_t(0));
+    };
+
+    auto precondition = [&]()
+    {
+        if(preconditioner)
+            preconditioner->apply(residual.data(), preconditioned.data());
+        else
+            preconditioned = residual;
+    };
+
+    op.apply(x, product.data());
+    for(size_t index = 0; index < size; ++index)
+        residual[index] = b[index] - product[index];
+    precondition();
+    direction = preconditioned;
+
+    //(r, M^-1 r), (r, r) и (b, b) - одной редукцией
+    values_t dots[3] = {dot(residual.data(), preconditioned.data()), dot(residual.data(), residual.data()),
+                        dot(b, b)};
+    MPI_Allreduce(MPI_IN_PLACE, dots, 3, MPI_VALUES_TYPE, MPI_SUM, comm);
+
+    //Нулевая правая часть: решение x = 0
+    const values_t bNorm = dots[2] > 0 ? std::sqrt(dots[2]) : values_t(1);
+    values_t residualDotOld = dots[0];
+    values_t residualNorm = std::sqrt(dots[1]);
+
+    size_t iterations = 0;
+    while(iterations < maxIterations && residualNorm > tolerance * bNorm)
+    {
+        op.apply(direction.data(), product.data());
+        values_t alphaDivisor = dot(direction.data(), product.data());
+        MPI_Allreduce(MPI_IN_PLACE, &alphaDivisor, 1, MPI_VALUES_TYPE, MPI_SUM, comm);
+
+        const values_t alpha = residualDotOld / alphaDivisor;
+        for(size_t index = 0; index < size; ++index)
+        {
+            x[index] += alpha * direction[index];
+            residual[index] -= alpha * product[index];
+        }
+
+        precondition();
+        dots[0] = dot(residual.data(), preconditioned.data());
+        dots[1] = dot(residual.data(), residual.data());
+        MPI_Allreduce(MPI_IN_PLACE, dots, 2, MPI_VALUES_TYPE, MPI_SUM, comm);
+
+        const values_t betta = dots[0] / residualDotOld;
+        residualDotOld = dots[0];
+        residualNorm = std::sqrt(dots[1]);
+
+        for(size_t index = 0; index < size; ++index)
+            direction[index] = preconditioned[index] + betta * direction[index];
+        ++iterations;
+    }
+
+    return std::make_pair(residualNorm / bNorm, iterations);
+}
+
+#endif // LINEAROPERATOR_H
@@ -0,0 +1,320 @@
+#ifndef OUTOFCORESLICE_H
+#define OUTOFCORESLICE_H
+
+#include "slice.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Кусок поля, хранящийся на диске (два отображенных в память файла: текущее и следующее поколение).
+ * Шаг игры проходит файл полосами строк: в памяти держится скользящее окно из трех строк с границами,
+ * следующая полоса заранее подгружается ядром (MADV_WILLNEED), пройденная - освобождается.
+ * Первый и последний столбцы, население и хэш куска считаются попутно, без отдельного прохода по файлу.
+ * Интерфейс обмена границами совпадает с DeepExtendedSlice глубины 1.
+ */
+struct OutOfCoreSlice
+{
+    /*!
+     * \brief Конструктор
+     * \param path префикс имени временных файлов куска (файлы удаляются из каталога сразу после создания)
+     * \param globalX, globalY координаты левого верхнего угла куска в поле
+     * \param strideX ширина куска
+     * \param strideY высота куска
+     * \param bandRows количество строк в полосе подгрузки
+     */
+    OutOfCoreSlice(const std::string& path, const size_t globalX, const size_t globalY,
+                   const size_t strideX, const size_t strideY, const size_t bandRows):
+        m_strideX{strideX},
+        m_strideY{strideY},
+        m_depth{1},
+        m_upperBound(strideX, 0),
+        m_lowerBound(strideX, 0),
+        m_leftExtendedBound(strideY + 2, 0),
+        m_rightExtendedBound(strideY + 2, 0),
+        m_globalX{globalX},
+        m_globalY{globalY},
+        m_bandRows{std::max<size_t>(bandRows, 1)},
+        m_current{0},
+        m_firstColumn(strideY, 0),
+        m_lastColumn(strideY, 0),
+        m_hash{0},
+        m_population{0}
+    {
+        for(size_t generation = 0; generation < 2; ++generation)
+        {
+            const std::string fileName = path + "." + std::to_string(generation);
+            m_files[generation] = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            //Имя удаляется сразу: файл живет, пока открыт и отображен, и не остается на диске даже при аварийном завершении
+            if(m_files[generation] >= 0)
+                unlink(fileName.c_str());
+            if(m_files[generation] < 0 || ftruncate(m_files[generation], bytes()) != 0)
+                throw std::runtime_error("Can not create slice file " + fileName);
+
+            void* data = mmap(nullptr, bytes(), PROT_READ | PROT_WRITE, MAP_SHARED, m_files[generation], 0);
+            if(data == MAP_FAILED)
+                throw std::runtime_error("Can not map slice file " + fileName);
+            madvise(data, bytes(), MADV_SEQUENTIAL);
+            m_data[generation] = static_cast<values_t*>(data);
+        }
+
+        for(size_t row = 0; row < 3; ++row)
+            m_window[row].resize(m_strideX + 2, 0);
+    }
+
+    OutOfCoreSlice(const OutOfCoreSlice&) = delete;
+    OutOfCoreSlice& operator=(const OutOfCoreSlice&) = delete;
+
+    ~OutOfCoreSlice()
+    {
+        for(size_t generation = 0; generation < 2; ++generation)
+        {
+            munmap(m_data[generation], bytes());
+            close(m_files[generation]);
+        }
+    }
+
+    /*!
+     * \brief Заполняет кусок построчно
+     * \param rowGenerator функция (номер строки, указатель на строку), заполняющая строку
+     */
+    template<typename RowGenerator>
+    void fill(RowGenerator rowGenerator)
+    {
+        m_hash = 0;
+        m_population = 0;
+
+        values_t* const data = m_data[m_current];
+        for(size_t row = 0; row < m_strideY; ++row)
+        {
+            values_t* const rowData = data + row * m_strideX;
+            rowGenerator(row, rowData);
+            finishRow(row, rowData);
+            if((row + 1) % m_bandRows == 0 || row + 1 == m_strideY)
+                releaseBand(data, row - row % m_bandRows, true);
+        }
+    }
+
+    /*!
+     * \brief При глубине 1 внешние границы поля просто остаются нулевыми
+     */
+    void setDeadBounds(const bool, const bool, const bool, const bool)
+    {}
+
+    std::vector<values_t> getUpperRows() const
+    {
+        const values_t* data = m_data[m_current];
+        return std::vector<values_t>{data, data + m_strideX};
+    }
+
+    std::vector<values_t> getLowerRows() const
+    {
+        const values_t* data = m_data[m_current] + (m_strideY - 1) * m_strideX;
+        return std::vector<values_t>{data, data + m_strideX};
+    }
+
+    std::vector<values_t> getFirstExtendedColumns() const
+    {
+        return extendedColumn(m_firstColumn, m_upperBound.front(), m_lowerBound.front());
+    }
+
+    std::vector<values_t> getLastExtendedColumns() const
+    {
+        return extendedColumn(m_lastColumn, m_upperBound.back(), m_lowerBound.back());
+    }
+
+    /*!
+     * \brief Делает шаг игры, используя текущие границы
+     * \param steps количество шагов (не больше 1)
+     */
+    void lifeSteps(const size_t steps)
+    {
+        assert(steps <= m_depth);
+        if(!steps)
+            return;
+
+        const values_t* const source = m_data[m_current];
+        values_t* const destination = m_data[1 - m_current];
+
+        m_hash = 0;
+        m_population = 0;
+
+        prefetchBand(source, 0);
+        loadWindowRow(source, -1, m_window[0]);
+        loadWindowRow(source, 0, m_window[1]);
+
+        for(size_t row = 0; row < m_strideY; ++row)
+        {
+            //Пока считается текущая полоса, ядро читает следующую
+            if(row % m_bandRows == 0)
+                prefetchBand(source, row + m_bandRows);
+
+            std::vector<values_t>& upper = m_window[row % 3];
+            std::vector<values_t>& middle = m_window[(row + 1) % 3];
+            std::vector<values_t>& lower = m_window[(row + 2) % 3];
+            loadWindowRow(source, static_cast<ptrdiff_t>(row) + 1, lower);
+
+            values_t* const rowData = destination + row * m_strideX;
+            for(size_t column = 0; column < m_strideX; ++column)
+            {
+                const int aliveNeighbors = upper[column] + upper[column + 1] + upper[column + 2] +
+                                           middle[column] + middle[column + 2] +
+                                           lower[column] + lower[column + 1] + lower[column + 2];
+                rowData[column] = (aliveNeighbors == 3) | (middle[column + 1] & (aliveNeighbors == 2));
+            }
+            finishRow(row, rowData);
+
+            if((row + 1) % m_bandRows == 0 || row + 1 == m_strideY)
+            {
+                const size_t bandRow = row - row % m_bandRows;
+                releaseBand(destination, bandRow, true);
+                //Предыдущая полоса источника больше не нужна (текущая еще нужна для следующей строки)
+                if(bandRow >= m_bandRows)
+                    releaseBand(source, bandRow - m_bandRows, false);
+                if(row + 1 == m_strideY)
+                    releaseBand(source, bandRow, false);
+            }
+        }
+
+        m_current = 1 - m_current;
+    }
+
+    /*!
+     * \brief Хэш клеток куска (см. cellsHash)
+     */
+    uint64_t hash() const
+    {
+        return m_hash;
+    }
+
+    /*!
+     * \brief Количество живых клеток в куске
+     */
+    size_t population() const
+    {
+        return m_population;
+    }
+
+    const size_t m_strideX;
+    const size_t m_strideY;
+    const size_t m_depth;//!< Глубина границ (всегда 1)
+    std::vector<values_t> m_upperBound;
+    std::vector<values_t> m_lowerBound;
+    std::vector<values_t> m_leftExtendedBound;
+    std::vector<values_t> m_rightExtendedBound;
+
+private:
+    size_t bytes() const
+    {
+        return m_strideX * m_strideY * sizeof(values_t);
+    }
+
+    /*!
+     * \brief Диапазон памяти полосы, расширенный до границ страниц
+     * \param data отображение файла
+     * \param firstRow первая строка полосы
+     * \param length длина диапазона в байтах
+     * \return начало диапазона
+     */
+    values_t* bandRange(const values_t* data, const size_t firstRow, size_t& length) const
+    {
+        const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const size_t lastRow = std::min(firstRow + m_bandRows, m_strideY);
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(data + firstRow * m_strideX) & ~(pageSize - 1);
+        const uintptr_t end = reinterpret_cast<uintptr_t>(data + lastRow * m_strideX);
+        length = end - begin;
+        return reinterpret_cast<values_t*>(begin);
+    }
+
+    /*!
+     * \brief Просит ядро асинхронно подгрузить полосу
+     */
+    void prefetchBand(const values_t* data, const size_t firstRow) const
+    {
+        if(firstRow >= m_strideY)
+            return;
+
+        size_t length = 0;
+        values_t* const address = bandRange(data, firstRow, length);
+        madvise(address, length, MADV_WILLNEED);
+    }
+
+    /*!
+     * \brief Завершает работу с полосой: записанная сбрасывается на диск, прочитанная выгружается из памяти
+     */
+    void releaseBand(const values_t* data, const size_t firstRow, const bool written) const
+    {
+        size_t length = 0;
+        values_t* const address = bandRange(data, firstRow, length);
+        if(written)
+            msync(address, length, MS_ASYNC);
+        else
+            madvise(address, length, MADV_DONTNEED);
+    }
+
+    /*!
+     * \brief Загружает строку куска вместе с левой и правой границами в окно
+     * \param row номер строки (от -1 до m_strideY)
+     */
+    void loadWindowRow(const values_t* source, const ptrdiff_t row, std::vector<values_t>& windowRow) const
+    {
+        const size_t extendedRow = row + 1;
+        windowRow.front() = m_leftExtendedBound[extendedRow];
+        windowRow.back() = m_rightExtendedBound[extendedRow];
+
+        const values_t* rowData;
+        if(row < 0)
+            rowData = m_upperBound.data();
+        else if(row >= static_cast<ptrdiff_t>(m_strideY))
+            rowData = m_lowerBound.data();
+        else
+            rowData = source + row * m_strideX;
+        std::memcpy(windowRow.data() + 1, rowData, m_strideX * sizeof(values_t));
+    }
+
+    /*!
+     * \brief Учитывает готовую строку в столбцах, хэше и населении
+     */
+    void finishRow(const size_t row, const values_t* rowData)
+    {
+        m_firstColumn[row] = rowData[0];
+        m_lastColumn[row] = rowData[m_strideX - 1];
+        m_hash += cellsHash(rowData, m_strideX, m_globalX, m_globalY + row);
+        for(size_t column = 0; column < m_strideX; ++column)
+            m_population += rowData[column] ? 1 : 0;
+    }
+
+    static std::vector<values_t> extendedColumn(const std::vector<values_t>& column, const values_t upper, const values_t lower)
+    {
+        std::vector<values_t> result;
+        result.reserve(column.size() + 2);
+        result.push_back(upper);
+        result.insert(result.end(), column.begin(), column.end());
+        result.push_back(lower);
+        return result;
+    }
+
+    const size_t m_globalX;//!< Координаты куска в поле (для хэша)
+    const size_t m_globalY;
+    const size_t m_bandRows;//!< Строк в полосе подгрузки
+    int m_files[2];//!< Файлы двух поколений
+    values_t* m_data[2];//!< Отображения файлов в память
+    size_t m_current;//!< Индекс текущего поколения
+    std::vector<values_t> m_window[3];//!< Скользящее окно строк с границами
+    std::vector<values_t> m_firstColumn;//!< Первый столбец текущего поколения
+    std::vector<values_t> m_lastColumn;//!< Последний столбец текущего поколения
+    uint64_t m_hash;//!< Хэш текущего поколения
+    size_t m_population;//!< Население текущего поколения
+};
+
+#endif // OUTOFCORESLICE_H
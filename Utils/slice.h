@@ -8,27 +8,62 @@
 #include <vector>
 #include <ctime>
 #include <cstdlib>
+#include <cstdint>
+
+/*!
+ * \brief Перемешивание 64-битного значения (финализатор splitmix64)
+ */
+inline uint64_t mixHash(uint64_t value)
+{
+    value += 0x9e3779b97f4a7c15ull;
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ull;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebull;
+    value ^= value >> 31;
+    return value;
+}
+
+/*!
+ * \brief Хэш строки клеток, не зависящий от нарезки поля на куски: сумма перемешанных глобальных координат
+ * ненулевых клеток. Хэши частей поля складываются (по модулю 2^64) в хэш всего поля при любом разбиении.
+ * \param values значения клеток строки
+ * \param count количество клеток
+ * \param globalX, globalY глобальные координаты первой клетки
+ * \return хэш
+ */
+inline uint64_t cellsHash(const values_t* values, const size_t count, const size_t globalX, const size_t globalY)
+{
+    const uint64_t rowKey = static_cast<uint64_t>(globalY) << 32;
+    uint64_t hash = 0;
+    for(size_t index = 0; index < count; ++index)
+        if(values[index])
+            hash += mixHash(rowKey + globalX + index);
+    return hash;
+}
 
 /*!
  * \brief Кусок поля
+ * \tparam T тип значений клеток
  */
-struct Slice
+template<typename T>
+struct BasicSlice
 {
-    Slice():
+    BasicSlice():
         m_globalX{0},
         m_globalY{0},
         m_stride{0}
     {}
 
-    Slice(const size_t globalX, const size_t globalY, const size_t stride):
+    BasicSlice(const size_t globalX, const size_t globalY, const size_t stride):
         m_globalX{globalX},
         m_globalY{globalY},
         m_stride{stride}
     {}
 
-    static Slice makeRandomSlice(const size_t globalX, const size_t globalY, const size_t strideX, const size_t strideY)
+    static BasicSlice makeRandomSlice(const size_t globalX, const size_t globalY, const size_t strideX, const size_t strideY)
     {
-        Slice slice(globalX, globalY, strideX);
+        BasicSlice slice(globalX, globalY, strideX);
         slice.m_values.resize(strideX * strideY, 0);
 
         srand(time(0));
@@ -42,9 +77,9 @@ struct Slice
         return slice;
     }
 
-    static Slice makeZeroSlice(const size_t globalX, const size_t globalY, const size_t strideX, const size_t strideY)
+    static BasicSlice makeZeroSlice(const size_t globalX, const size_t globalY, const size_t strideX, const size_t strideY)
     {
-        Slice slice(globalX, globalY, strideX);
+        BasicSlice slice(globalX, globalY, strideX);
         slice.m_values.resize(strideX * strideY, 0);
         return slice;
     }
@@ -52,37 +87,44 @@ struct Slice
     size_t m_globalX;
     size_t m_globalY;
     size_t m_stride;
-    std::vector<values_t> m_values;
+    std::vector<T> m_values;
 };
 
 /*!
  * \brief Поле (разбитое на куски)
+ * \tparam T тип значений клеток
  */
-struct Field
+template<typename T>
+struct BasicField
 {
-    Field():
+    BasicField():
         m_width{0},
         m_height{0}
     {}
 
-    Field(const size_t width, const size_t height):
+    BasicField(const size_t width, const size_t height):
         m_width{width},
         m_height{height}
     {}
 
     size_t m_width;
     size_t m_height;
-    std::vector<Slice> m_slices;
+    std::vector<BasicSlice<T>> m_slices;
 };
 
-bool operator==(const Slice& lhs, const Slice& rhs)
+typedef BasicSlice<values_t> Slice;
+typedef BasicField<values_t> Field;
+
+template<typename T>
+inline bool operator==(const BasicSlice<T>& lhs, const BasicSlice<T>& rhs)
 {
     return lhs.m_globalX==rhs.m_globalX &&
            lhs.m_globalY==rhs.m_globalY &&
            lhs.m_stride==rhs.m_stride;
 }
 
-bool operator==(const Field& lhs, const Field& rhs)
+template<typename T>
+inline bool operator==(const BasicField<T>& lhs, const BasicField<T>& rhs)
 {
     return lhs.m_width==rhs.m_width &&
            lhs.m_height==rhs.m_height;
@@ -92,8 +134,8 @@ namespace boost
 {
     namespace serialization
     {
-        template<class Archive>
-        void serialize(Archive& ar, Slice& slice, const unsigned int version)
+        template<class Archive, typename T>
+        void serialize(Archive& ar, BasicSlice<T>& slice, const unsigned int version)
         {
             ar & slice.m_globalX;
             ar & slice.m_globalY;
@@ -101,8 +143,8 @@ namespace boost
             ar & slice.m_values;
         }
 
-        template<class Archive>
-        void serialize(Archive& ar, Field& field, const unsigned int version)
+        template<class Archive, typename T>
+        void serialize(Archive& ar, BasicField<T>& field, const unsigned int version)
         {
             ar & field.m_width;
             ar & field.m_height;
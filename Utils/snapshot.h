@@ -0,0 +1,299 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "slice.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Формат снимка поля (все числа - uint64_t в порядке байт машины, если не указано иное):
+ *   заголовок SnapshotHeader;
+ *   индекс кусков - m_slicesCount записей SnapshotSliceEntry;
+ *   данные кусков - строки каждого куска подряд, начало куска выровнено на SNAPSHOT_ALIGNMENT.
+ * Снимок можно отобразить в память и читать без разбора и копирования: открытие читает только
+ * заголовок, любая область поля читается по индексу без обращения к остальным данным.
+ */
+
+const char SNAPSHOT_MAGIC[8] = {'L', 'A', 'B', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t SNAPSHOT_VERSION = 1u;
+const size_t SNAPSHOT_ALIGNMENT = 64u;//!< Выравнивание данных кусков (строка кэша)
+
+/*!
+ * \brief Заголовок снимка
+ */
+struct SnapshotHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_valueSize;//!< sizeof типа значений клеток
+    uint64_t m_width;
+    uint64_t m_height;
+    uint64_t m_slicesCount;
+    uint64_t m_indexOffset;//!< Смещение индекса кусков от начала файла
+};
+
+/*!
+ * \brief Запись индекса кусков
+ */
+struct SnapshotSliceEntry
+{
+    uint64_t m_globalX;
+    uint64_t m_globalY;
+    uint64_t m_stride;//!< Ширина куска
+    uint64_t m_rows;//!< Высота куска
+    uint64_t m_offset;//!< Смещение данных куска от начала файла
+};
+
+inline uint64_t snapshotAligned(const uint64_t offset)
+{
+    return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+/*!
+ * \brief Размер значения клетки в снимке, не отображая его в память
+ * \param path имя файла
+ * \return sizeof типа значений или 0, если файл не является снимком
+ */
+inline uint32_t snapshotValueSize(const std::string& path)
+{
+    std::ifstream is(path, std::ios::binary);
+    SnapshotHeader header;
+    if(!is.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+       std::memcmp(header.m_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+       header.m_version != SNAPSHOT_VERSION)
+        return 0;
+    return header.m_valueSize;
+}
+
+/*!
+ * \brief Записывает поле в снимок. Файл заменяется атомарно (запись во временный файл и переименование),
+ * поэтому читатели, отобразившие старый снимок, продолжают видеть его целиком.
+ * \param path имя файла
+ * \param field поле
+ */
+template<typename T>
+void writeSnapshot(const std::string& path, const BasicField<T>& field)
+{
+    SnapshotHeader header;
+    std::memcpy(header.m_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.m_version = SNAPSHOT_VERSION;
+    header.m_valueSize = sizeof(T);
+    header.m_width = field.m_width;
+    header.m_height = field.m_height;
+    header.m_slicesCount = field.m_slices.size();
+    header.m_indexOffset = sizeof(SnapshotHeader);
+
+    std::vector<SnapshotSliceEntry> index(field.m_slices.size());
+    uint64_t offset = snapshotAligned(header.m_indexOffset + index.size() * sizeof(SnapshotSliceEntry));
+    for(size_t slice = 0; slice < index.size(); ++slice)
+    {
+        const BasicSlice<T>& fieldSlice = field.m_slices[slice];
+        index[slice].m_globalX = fieldSlice.m_globalX;
+        index[slice].m_globalY = fieldSlice.m_globalY;
+        index[slice].m_stride = fieldSlice.m_stride;
+        index[slice].m_rows = fieldSlice.m_stride ? fieldSlice.m_values.size() / fieldSlice.m_stride : 0;
+        index[slice].m_offset = offset;
+        offset = snapshotAligned(offset + fieldSlice.m_values.size() * sizeof(T));
+    }
+
+    const std::string tmpName = path + ".tmp";
+    {
+        std::ofstream os(tmpName, std::ios::binary | std::ios::trunc);
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(SnapshotSliceEntry));
+
+        const char padding[SNAPSHOT_ALIGNMENT] = {};
+        for(size_t slice = 0; slice < index.size(); ++slice)
+        {
+            os.write(padding, index[slice].m_offset - static_cast<uint64_t>(os.tellp()));
+            os.write(reinterpret_cast<const char*>(field.m_slices[slice].m_values.data()),
+                     field.m_slices[slice].m_values.size() * sizeof(T));
+        }
+        if(!os)
+            throw std::runtime_error("Can not write snapshot " + tmpName);
+    }
+
+    if(std::rename(tmpName.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("Can not replace snapshot " + path);
+}
+
+/*!
+ * \brief Снимок, отображенный в память (только чтение)
+ * \tparam T тип значений клеток (должен совпадать с записанным)
+ */
+template<typename T>
+class SnapshotView
+{
+public:
+    /*!
+     * \brief Отображает снимок в память, проверяя заголовок и индекс: каждый кусок должен лежать
+     * внутри поля и внутри файла (данные кусков не читаются)
+     * \param path имя файла
+     */
+    explicit SnapshotView(const std::string& path):
+        m_data{nullptr},
+        m_bytes{0}
+    {
+        const int file = open(path.c_str(), O_RDONLY);
+        if(file < 0)
+            throw std::runtime_error("Can not open snapshot " + path);
+
+        struct stat info;
+        if(fstat(file, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotHeader))
+        {
+            close(file);
+            throw std::runtime_error("Snapshot " + path + " is truncated");
+        }
+
+        m_bytes = info.st_size;
+        void* data = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, file, 0);
+        close(file);
+        if(data == MAP_FAILED)
+            throw std::runtime_error("Can not map snapshot " + path);
+        m_data = static_cast<const char*>(data);
+
+        const SnapshotHeader& header = this->header();
+        if(std::memcmp(header.m_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+           header.m_version != SNAPSHOT_VERSION ||
+           header.m_valueSize != sizeof(T) ||
+           header.m_indexOffset > m_bytes ||
+           header.m_slicesCount > (m_bytes - header.m_indexOffset) / sizeof(SnapshotSliceEntry))
+        {
+            munmap(const_cast<char*>(m_data), m_bytes);
+            throw std::runtime_error("Snapshot " + path + " has unsupported format");
+        }
+
+        for(size_t index = 0; index < slicesCount(); ++index)
+            if(!entryValid(slice(index)))
+            {
+                munmap(const_cast<char*>(m_data), m_bytes);
+                throw std::runtime_error("Snapshot " + path + " is corrupted");
+            }
+    }
+
+    SnapshotView(const SnapshotView&) = delete;
+    SnapshotView& operator=(const SnapshotView&) = delete;
+
+    ~SnapshotView()
+    {
+        munmap(const_cast<char*>(m_data), m_bytes);
+    }
+
+    size_t width() const
+    {
+        return header().m_width;
+    }
+
+    size_t height() const
+    {
+        return header().m_height;
+    }
+
+    size_t slicesCount() const
+    {
+        return header().m_slicesCount;
+    }
+
+    const SnapshotSliceEntry& slice(const size_t index) const
+    {
+        if(index >= slicesCount())
+            throw std::runtime_error("Snapshot slice index is out of range");
+        return reinterpret_cast<const SnapshotSliceEntry*>(m_data + header().m_indexOffset)[index];
+    }
+
+    /*!
+     * \brief Строка куска прямо в отображенной памяти
+     * \param index номер куска
+     * \param row номер строки куска
+     */
+    const T* row(const size_t index, const size_t row) const
+    {
+        const SnapshotSliceEntry& entry = slice(index);
+        if(entry.m_offset + (row + 1) * entry.m_stride * sizeof(T) > m_bytes)
+            throw std::runtime_error("Snapshot slice is out of file bounds");
+        return reinterpret_cast<const T*>(m_data + entry.m_offset) + row * entry.m_stride;
+    }
+
+    /*!
+     * \brief Копирует прямоугольник поля (читаются только строки пересекающих его кусков)
+     * \param x левая граница
+     * \param y верхняя граница
+     * \param width ширина прямоугольника
+     * \param height высота прямоугольника
+     * \param destination width * height значений построчно (клетки вне кусков не меняются)
+     */
+    void readRegion(const size_t x, const size_t y, const size_t width, const size_t height, T* destination) const
+    {
+        for(size_t index = 0; index < slicesCount(); ++index)
+        {
+            const SnapshotSliceEntry& entry = slice(index);
+            const size_t firstX = std::max<size_t>(x, entry.m_globalX);
+            const size_t lastX = std::min<size_t>(x + width, entry.m_globalX + entry.m_stride);
+            const size_t firstY = std::max<size_t>(y, entry.m_globalY);
+            const size_t lastY = std::min<size_t>(y + height, entry.m_globalY + entry.m_rows);
+            if(firstX >= lastX || firstY >= lastY)
+                continue;
+
+            for(size_t globalY = firstY; globalY < lastY; ++globalY)
+                std::memcpy(destination + (globalY - y) * width + (firstX - x),
+                            row(index, globalY - entry.m_globalY) + (firstX - entry.m_globalX),
+                            (lastX - firstX) * sizeof(T));
+        }
+    }
+
+    /*!
+     * \brief Копирует снимок в поле (для продолжения расчета)
+     */
+    BasicField<T> toField() const
+    {
+        BasicField<T> field(width(), height());
+        field.m_slices.reserve(slicesCount());
+        for(size_t index = 0; index < slicesCount(); ++index)
+        {
+            const SnapshotSliceEntry& entry = slice(index);
+            BasicSlice<T> fieldSlice(entry.m_globalX, entry.m_globalY, entry.m_stride);
+            if(entry.m_rows)
+            {
+                const T* values = row(index, entry.m_rows - 1) - (entry.m_rows - 1) * entry.m_stride;
+                fieldSlice.m_values.assign(values, values + entry.m_rows * entry.m_stride);
+            }
+            field.m_slices.push_back(std::move(fieldSlice));
+        }
+        return field;
+    }
+
+private:
+    const SnapshotHeader& header() const
+    {
+        return *reinterpret_cast<const SnapshotHeader*>(m_data);
+    }
+
+    /*!
+     * \brief Лежит ли кусок внутри поля и внутри файла (сравнения без переполнения)
+     */
+    bool entryValid(const SnapshotSliceEntry& entry) const
+    {
+        if(entry.m_globalX > width() || entry.m_stride > width() - entry.m_globalX ||
+           entry.m_globalY > height() || entry.m_rows > height() - entry.m_globalY ||
+           entry.m_offset > m_bytes)
+            return false;
+        return !entry.m_stride || entry.m_rows <= (m_bytes - entry.m_offset) / sizeof(T) / entry.m_stride;
+    }
+
+    const char* m_data;
+    size_t m_bytes;
+};
+
+#endif // SNAPSHOT_H